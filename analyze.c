@@ -0,0 +1,523 @@
+/*
+ * analyze.c: output of the units found with -y
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "analyze.h"
+#include "rate.h"
+#include "element.h"
+#include "pes.h"
+
+/* all output goes through one buffer and is written in large pieces,
+   a line never needs more than AN_LINE bytes */
+#define AN_BUF  (64*1024)
+#define AN_LINE 512
+
+#define AN_STREAMS  32
+#define AN_GOPS     64      // longer GOPs are counted in the last bucket
+#define AN_SIZES    32      // frame sizes by powers of 2
+#define AN_DISCONS  64      // discontinuities listed in the summary
+#define AN_ERRS     (DROP_ERR+1)
+
+typedef struct an_discon_s{
+	int kind;
+	int n;
+	uint64_t unit;
+	uint64_t ts;
+	int64_t delta;
+	int64_t expected;
+} an_discon;
+
+typedef struct an_stream_s{
+	uint64_t units;
+	uint64_t bytes;
+	uint64_t errs[AN_ERRS];
+
+	// last unit for the text output
+	uint64_t last_pts;
+	uint64_t last_dts;
+
+	// time stamps for the summary
+	uint64_t last_ts;
+	int since;            // units since the last time stamp
+	int64_t period;       // time of one unit, once it was seen twice
+	int64_t cand;
+
+	// video only
+	uint64_t frames[4];
+	uint32_t min_size[4];
+	uint32_t max_size[4];
+	uint64_t sum_size[4];
+	uint64_t sizes[AN_SIZES];
+	uint64_t gops[AN_GOPS+1];
+	int gop_len;
+} an_stream;
+
+static int format;
+static int active;
+static char obuf[AN_BUF];
+static int olen;
+static an_stream streams[AN_KINDS][AN_STREAMS];
+static an_discon discons[AN_DISCONS];
+static uint64_t ndiscons;
+
+static const char *kind_name[AN_KINDS] = { "video", "mpa", "ac3" };
+static const char *frame_name[4] = { "", "I", "B", "P" };
+static const char *err_name[AN_ERRS] = {
+	"", "frame", "PTS", "jump", "dummy", "drop"
+};
+
+static void out_flush(void)
+{
+	int c = 0;
+
+	while (c < olen){
+		int w = write(STDOUT_FILENO, obuf+c, olen-c);
+		if (w < 0){
+			if (errno == EINTR) continue;
+			perror("Error writing analysis");
+			exit(1);
+		}
+		c += w;
+	}
+	olen = 0;
+}
+
+static inline char *out_reserve(void)
+{
+	if (olen > AN_BUF - AN_LINE) out_flush();
+	return obuf+olen;
+}
+
+static inline char *put_str(char *p, const char *s)
+{
+	while (*s) *p++ = *s++;
+	return p;
+}
+
+static char *put_u64(char *p, uint64_t v)
+{
+	char d[20];
+	int n = 0;
+
+	do {
+		d[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n) *p++ = d[--n];
+	return p;
+}
+
+/* same as printptss */
+static char *put_pts(char *p, int64_t pts)
+{
+	unsigned int s, ms;
+
+	if (pts < 0){
+		*p++ = '-';
+		pts = -pts;
+	}
+	pts = pts/300;
+	pts &= (MAX_PTS-1);
+	s = pts/90000;
+	ms = (pts/90)%1000;
+	return p + sprintf(p, "%2d:%02d:%02d.%03d ", s/3600, (s%3600)/60,
+			   s%60, ms);
+}
+
+static inline char *put_le(char *p, uint64_t v, int n)
+{
+	while (n--){
+		*p++ = v & 0xff;
+		v >>= 8;
+	}
+	return p;
+}
+
+int analyze_format(const char *name)
+{
+	static const char *names[] = { "text", "csv", "json", "bin",
+				       "summary", "rate", NULL };
+	int i;
+
+	for (i = 0; names[i]; i++)
+		if (!strcmp(name, names[i])) return i;
+	return -1;
+}
+
+void analyze_init(int f)
+{
+	char *p;
+
+	format = f;
+	active = 1;
+	olen = 0;
+	ndiscons = 0;
+	memset(streams, 0, sizeof(streams));
+
+	p = out_reserve();
+	switch (format){
+	case AN_RATE:
+		rate_init();
+		break;
+	case AN_CSV:
+		p = put_str(p, "stream,n,frame,seq,gop,err,length,pts,dts\n");
+		break;
+	case AN_BIN:
+		p = put_str(p, AN_MAGIC);
+		p = put_le(p, AN_REC_SIZE, 4);
+		break;
+	}
+	olen = p - obuf;
+}
+
+static void unit_text(int kind, int n, index_unit *iu, an_stream *s)
+{
+	char *p = out_reserve();
+
+	switch (kind){
+	case AN_MPA:
+	case AN_AC3:
+		p += sprintf(p, "%s Audio%d unit:  length %d  PTS ",
+			     kind == AN_MPA ? "MPG2" : "AC3", n, iu->length);
+		p = put_pts(p, iu->pts);
+		if (s->last_pts){
+			p = put_str(p, "  diff:");
+			p = put_pts(p, ptsdiff(iu->pts, s->last_pts));
+		}
+		s->last_pts = iu->pts;
+		break;
+
+	case AN_VIDEO:
+		p = put_str(p, "Video unit: ");
+		if (iu->seq_header) p = put_str(p, "Sequence header ");
+		if (iu->gop) p = put_str(p, "GOP header ");
+		switch (iu->frame){
+		case I_FRAME:
+			p = put_str(p, "I-frame");
+			break;
+		case B_FRAME:
+			p = put_str(p, "B-frame");
+			break;
+		case P_FRAME:
+			p = put_str(p, "P-frame");
+			break;
+		}
+		p += sprintf(p, " length %d  PTS ", iu->length);
+		p = put_pts(p, iu->pts);
+		if (s->last_pts){
+			p = put_str(p, "  diff:");
+			p = put_pts(p, ptsdiff(iu->pts, s->last_pts));
+		}
+		s->last_pts = iu->pts;
+		p = put_str(p, "  DTS ");
+		p = put_pts(p, iu->dts);
+		if (s->last_dts){
+			p = put_str(p, "  diff:");
+			p = put_pts(p, ptsdiff(iu->dts, s->last_dts));
+		}
+		s->last_dts = iu->dts;
+		break;
+	}
+	*p++ = '\n';
+	olen = p - obuf;
+}
+
+static inline uint64_t ts90(uint64_t ts)
+{
+	return (ts/300) & (MAX_PTS-1);
+}
+
+static void unit_record(int kind, int n, index_unit *iu)
+{
+	char *p = out_reserve();
+	int frame = kind == AN_VIDEO && iu->frame < 4 ? iu->frame : 0;
+	int seq = kind == AN_VIDEO && iu->seq_header;
+	int gop = kind == AN_VIDEO && iu->gop;
+
+	switch (format){
+	case AN_CSV:
+		p = put_str(p, kind_name[kind]);
+		*p++ = ',';
+		p = put_u64(p, n);
+		*p++ = ',';
+		p = put_str(p, frame_name[frame]);
+		*p++ = ',';
+		*p++ = '0' + seq;
+		*p++ = ',';
+		*p++ = '0' + gop;
+		*p++ = ',';
+		p = put_u64(p, iu->err);
+		*p++ = ',';
+		p = put_u64(p, iu->length);
+		*p++ = ',';
+		p = put_u64(p, ts90(iu->pts));
+		*p++ = ',';
+		if (kind == AN_VIDEO) p = put_u64(p, ts90(iu->dts));
+		*p++ = '\n';
+		break;
+
+	case AN_JSON:
+		p = put_str(p, "{\"stream\":\"");
+		p = put_str(p, kind_name[kind]);
+		p = put_str(p, "\",\"n\":");
+		p = put_u64(p, n);
+		if (kind == AN_VIDEO){
+			p = put_str(p, ",\"frame\":\"");
+			p = put_str(p, frame_name[frame]);
+			p = put_str(p, seq ? "\",\"seq\":true" :
+				    "\",\"seq\":false");
+			p = put_str(p, gop ? ",\"gop\":true" : ",\"gop\":false");
+		}
+		p = put_str(p, ",\"err\":");
+		p = put_u64(p, iu->err);
+		p = put_str(p, ",\"length\":");
+		p = put_u64(p, iu->length);
+		p = put_str(p, ",\"pts\":");
+		p = put_u64(p, ts90(iu->pts));
+		if (kind == AN_VIDEO){
+			p = put_str(p, ",\"dts\":");
+			p = put_u64(p, ts90(iu->dts));
+		}
+		p = put_str(p, "}\n");
+		break;
+
+	case AN_BIN:
+		*p++ = kind;
+		*p++ = n;
+		*p++ = frame;
+		*p++ = (seq ? AN_SEQ : 0) | (gop ? AN_GOP : 0) |
+			(iu->err << 4);
+		p = put_le(p, iu->length, 4);
+		p = put_le(p, ts90(iu->pts), 8);
+		p = put_le(p, kind == AN_VIDEO ? ts90(iu->dts) : 0, 8);
+		break;
+	}
+	olen = p - obuf;
+}
+
+/* A time stamp is expected where the last one plus the units since
+   then would put it. The time of a unit is taken once two time stamps
+   in a row agreed on it. */
+static void check_ts(int kind, int n, an_stream *s, uint64_t ts)
+{
+	int64_t delta, per;
+
+	s->since++;
+	if (!ts) return;
+	if (!s->last_ts){
+		s->last_ts = ts;
+		s->since = 0;
+		return;
+	}
+	delta = ptsdiff(ts, s->last_ts);
+	if (!delta) return;     // several units in one PES
+
+	if (s->period &&
+	    llabs(delta - s->since*s->period) > s->period/2){
+		if (ndiscons < AN_DISCONS){
+			an_discon *d = &discons[ndiscons];
+
+			d->kind = kind;
+			d->n = n;
+			d->unit = s->units;
+			d->ts = ts;
+			d->delta = delta;
+			d->expected = s->since*s->period;
+		}
+		ndiscons++;
+	} else if (delta > 0){
+		per = delta/s->since;
+		if (per == s->cand) s->period = per;
+		s->cand = per;
+	}
+	s->last_ts = ts;
+	s->since = 0;
+}
+
+static void unit_summary(int kind, int n, index_unit *iu, an_stream *s)
+{
+	if (iu->err < AN_ERRS) s->errs[iu->err]++;
+	if (kind != AN_VIDEO){
+		check_ts(kind, n, s, iu->pts);
+		return;
+	}
+
+	// B-frames only carry a PTS, which is their DTS
+	check_ts(kind, n, s, iu->dts ? iu->dts : iu->pts);
+	if (iu->gop){
+		if (s->gop_len)
+			s->gops[s->gop_len < AN_GOPS ? s->gop_len : AN_GOPS]++;
+		s->gop_len = 0;
+	}
+	if (iu->frame && iu->frame < 4){
+		int f = iu->frame;
+		int b = 0;
+
+		s->gop_len++;
+		if (!s->frames[f] || iu->length < s->min_size[f])
+			s->min_size[f] = iu->length;
+		if (iu->length > s->max_size[f]) s->max_size[f] = iu->length;
+		s->sum_size[f] += iu->length;
+		s->frames[f]++;
+		while (b < AN_SIZES-1 && (iu->length >> (b+1))) b++;
+		s->sizes[b]++;
+	}
+}
+
+void analyze_unit(int kind, int n, index_unit *iu)
+{
+	an_stream *s;
+
+	if (n >= AN_STREAMS) return;
+	s = &streams[kind][n];
+
+	switch (format){
+	case AN_TEXT:
+		unit_text(kind, n, iu, s);
+		break;
+	case AN_SUMMARY:
+		unit_summary(kind, n, iu, s);
+		break;
+	case AN_RATE:
+		rate_unit(kind, n, iu);
+		break;
+	default:
+		unit_record(kind, n, iu);
+		break;
+	}
+	s->units++;
+	s->bytes += iu->length;
+}
+
+static void print_size(uint32_t size)
+{
+	if (size < 10*1024) printf(" %7u", size);
+	else printf(" %6uK", size/1024);
+}
+
+static void summary_video(an_stream *s)
+{
+	int f, i, first = 1;
+
+	printf("  frames     ");
+	for (f = 1; f < 4; f++)
+		printf("  %s %llu", frame_name[f],
+		       (unsigned long long)s->frames[f]);
+	printf("\n  frame size      min     avg     max\n");
+	for (f = 1; f < 4; f++){
+		if (!s->frames[f]) continue;
+		printf("    %s        ", frame_name[f]);
+		print_size(s->min_size[f]);
+		print_size(s->sum_size[f]/s->frames[f]);
+		print_size(s->max_size[f]);
+		printf("\n");
+	}
+	printf("  frame sizes ");
+	for (i = 0; i < AN_SIZES; i++){
+		if (!s->sizes[i]) continue;
+		if (!first) printf(",");
+		first = 0;
+		if (i < 10) printf(" <%d: %llu", 2 << i,
+				   (unsigned long long)s->sizes[i]);
+		else printf(" <%dK: %llu", 2 << (i-10),
+			    (unsigned long long)s->sizes[i]);
+	}
+	if (s->gop_len)
+		s->gops[s->gop_len < AN_GOPS ? s->gop_len : AN_GOPS]++;
+	printf("\n  GOP length  ");
+	first = 1;
+	for (i = 1; i <= AN_GOPS; i++){
+		if (!s->gops[i]) continue;
+		if (!first) printf(",");
+		first = 0;
+		printf(" %s%d: %llu", i == AN_GOPS ? ">=" : "", i,
+		       (unsigned long long)s->gops[i]);
+	}
+	printf("\n");
+}
+
+static void summary_stream(int kind, int n, an_stream *s)
+{
+	int e;
+
+	if (kind == AN_VIDEO) printf("video: ");
+	else printf("%s %d: ", kind_name[kind], n);
+	printf("%llu units, %llu bytes", (unsigned long long)s->units,
+	       (unsigned long long)s->bytes);
+	if (s->period){
+		char t[AN_LINE];
+		*put_pts(t, s->period) = 0;
+		printf(", %s per unit", t);
+	}
+	for (e = 1; e < AN_ERRS; e++)
+		if (s->errs[e])
+			printf(", %s errors %llu", err_name[e],
+			       (unsigned long long)s->errs[e]);
+	printf("\n");
+	if (kind == AN_VIDEO) summary_video(s);
+}
+
+static void summary(void)
+{
+	int k, n;
+	uint64_t i;
+
+	for (k = 0; k < AN_KINDS; k++)
+		for (n = 0; n < AN_STREAMS; n++)
+			if (streams[k][n].units)
+				summary_stream(k, n, &streams[k][n]);
+
+	printf("PTS discontinuities: %llu\n", (unsigned long long)ndiscons);
+	for (i = 0; i < ndiscons && i < AN_DISCONS; i++){
+		an_discon *d = &discons[i];
+		char t[3][AN_LINE];
+
+		*put_pts(t[0], d->ts) = 0;
+		*put_pts(t[1], d->delta) = 0;
+		*put_pts(t[2], d->expected) = 0;
+		printf("  %s", kind_name[d->kind]);
+		if (d->kind != AN_VIDEO) printf(" %d", d->n);
+		printf(" unit %llu at %s jump %s expected %s\n",
+		       (unsigned long long)d->unit, t[0], t[1], t[2]);
+	}
+	if (ndiscons > AN_DISCONS)
+		printf("  ... %llu more\n",
+		       (unsigned long long)(ndiscons - AN_DISCONS));
+}
+
+void analyze_finish(void)
+{
+	if (!active) return;
+	active = 0;
+	out_flush();
+	if (format == AN_SUMMARY) summary();
+	if (format == AN_RATE) rate_report();
+	fflush(stdout);
+}
@@ -0,0 +1,61 @@
+/*
+ * analyze.h
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef _ANALYZE_H_
+#define _ANALYZE_H_
+
+#include <stdint.h>
+#include "mpg_common.h"
+
+/* output formats of -y, chosen with -Y */
+enum { AN_TEXT=0, AN_CSV, AN_JSON, AN_BIN, AN_SUMMARY, AN_RATE };
+
+/* kinds of streams */
+enum { AN_VIDEO=0, AN_MPA, AN_AC3, AN_KINDS };
+
+/* -Y bin writes an 8 byte header, "RXAN" and the record size as uint32,
+   followed by one record per unit:
+   0  uint8  kind (AN_VIDEO, AN_MPA, AN_AC3)
+   1  uint8  stream number
+   2  uint8  frame type (I_FRAME, B_FRAME, P_FRAME, 0 for audio)
+   3  uint8  flags, error (NO_ERR, FRAME_ERR, ...) in the upper 4 bits
+   4  uint32 length in bytes
+   8  uint64 PTS
+   16 uint64 DTS
+   All fields are little endian, PTS and DTS are in 90kHz units and 0
+   if the unit has none. */
+#define AN_MAGIC     "RXAN"
+#define AN_REC_SIZE  24
+
+#define AN_SEQ   0x01   // flags: sequence header
+#define AN_GOP   0x02   //        GOP header
+
+int analyze_format(const char *name);
+void analyze_init(int format);
+void analyze_unit(int kind, int n, index_unit *iu);
+void analyze_finish(void);
+
+#endif /*_ANALYZE_H_*/
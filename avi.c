@@ -32,6 +32,7 @@
 #include "avi.h"
 #include "replex.h"
 #include "pes.h"
+#include "fuzz.h"
 
 
 #define DEBUG 1
@@ -429,7 +430,7 @@ int get_avi_from_index(pes_in_t *p, int fd, avi_context *ac,
 	switch(idx[cidx].id){
 	case TAG_IT('0','1','w','b'):
 		p->type = 1;
-		p->rbuf = &rx->arbuffer[0];
+		p->rbuf = &rx->astream[0].rbuffer;
 		break;
 		
 	case TAG_IT('0','0','d','c'):
@@ -505,7 +506,10 @@ int get_avi_from_index(pes_in_t *p, int fd, avi_context *ac,
 }
 
 
-void get_avi(pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
+/* Parses up to the end of the current chunk, returns the number of
+   bytes used. */
+static int get_avi_chunk(pes_in_t *p, uint8_t *buf, int count, 
+			 void (*func)(pes_in_t *p))
 {
 	int l;
 	int c=0;
@@ -515,6 +519,7 @@ void get_avi(pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 //	show_buf(buf,16);
 	while (c < count && p->found < 8
 	       &&  !p->done){
+		FUZZ_WORK(1);
 		switch ( p->found ){
 		case 0:
 			if (buf[c] == '0') p->found++;
@@ -565,7 +570,7 @@ void get_avi(pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 			switch(p->type){
 
 			case 1:
-				p->rbuf = &rx->arbuffer[0];
+				p->rbuf = &rx->astream[0].rbuffer;
 				break;
 			
 			case 0xE0:
@@ -639,7 +644,16 @@ void get_avi(pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 	if (p->plength && p->found == p->plength+8) {
 		int a = 0;//ALIGN(p->plength);
 		init_pes_in(p, 0, NULL, p->withbuf);
-		if (c+a < count)
-			get_avi(p, buf+c+a, count-c-a, func);
+		return c+a;
 	}
+	return count;
+}
+
+void get_avi(pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
+{
+	int c = 0;
+	int n;
+
+	while (c < count && (n = get_avi_chunk(p, buf+c, count-c, func)) > 0)
+		c += n;
 }
@@ -0,0 +1,200 @@
+#!/bin/sh
+#
+# check.sh: run replex over the cases in golden/cases and compare the
+# results with the checksums and pack dumps stored in golden/
+#
+# usage: check.sh [-u] [<work dir>]
+#   -u  store the results as the new golden files
+#
+# Real recordings can be added with "clip" lines in golden/cases, they
+# are looked up in $CHECKCLIPS and skipped if they are not there.
+#
+
+GOLDEN=golden
+REPLEX=./replex
+MPGGEN=./mpggen
+RXDUMP=./rxdump
+
+update=0
+if [ "$1" = "-u" ]; then
+	update=1
+	shift
+fi
+dir=${1:-check.out}
+
+rm -rf "$dir"
+mkdir -p "$dir/in" || exit 1
+
+now() {
+	date +%s%N
+}
+
+ms() {
+	echo $(( ($2 - $1) / 1000000 ))
+}
+
+# name of the input file for an input or clip name, empty if missing
+input() {
+	if [ -f "$dir/in/$1" ]; then
+		echo "$dir/in/$1"
+	elif [ -f "$dir/in/$1.clip" ]; then
+		cat "$dir/in/$1.clip"
+	fi
+}
+
+run_case() {
+	name=$1 in=$2 log=$3
+	shift 3
+
+	case $in in
+	"<"*)
+		src=$(input "${in#<}")
+		stdin=$src
+		file=
+		;;
+	*)
+		src=$(input "$in")
+		stdin=/dev/null
+		file=$src
+		;;
+	esac
+	if [ -z "$src" ]; then
+		printf "%-16s skipped\n" "$name"
+		echo "$name" >> "$dir/skipped"
+		return
+	fi
+
+	args=
+	for a in "$@"; do
+		case $a in
+		@*) a="$dir/$name${a#@}" ;;
+		esac
+		args="$args $a"
+	done
+
+	start=$(now)
+	if [ "$kind" = "resume" ]; then
+		$REPLEX $args -X $file < "$stdin" > /dev/null 2>&1
+		args="$args -R"
+	fi
+	$REPLEX $args $file < "$stdin" > "$dir/$name.stdout" 2> "$dir/$name.err"
+	echo $? > "$dir/$name.rc"
+	end=$(now)
+	echo "$name $(ms $start $end)" >> "$dir/times"
+
+	[ -s "$dir/$name.stdout" ] || rm -f "$dir/$name.stdout"
+	if [ "$log" = "log" ]; then
+		tr '\r' '\n' < "$dir/$name.err" |
+		sed -e 's/read *[0-9]*%//g' -e 's/read *[0-9.]* MB//g' \
+		    -e '/^replex version /d' -e "s|$dir/||g" |
+		grep -v '^ *$' > "$dir/$name.log"
+	fi
+	for f in "$dir/$name.mpg" "$dir/$name.stdout"; do
+		[ -f "$f" ] || continue
+		$RXDUMP "$f" > "$f.dump"
+		[ -s "$f.dump" ] || rm -f "$f.dump"
+	done
+	printf "%-16s %6d ms\n" "$name" "$(ms $start $end)"
+}
+
+# a resume case has to give the same output as the case it repeats, that
+# is recorded instead of a second copy of the output
+same() {
+	for f in "$dir/$1".mpg "$dir/$1".stdout; do
+		[ -f "$f" ] || continue
+		cmp -s "$f" "$dir/$2${f#$dir/$1}" || return
+	done
+	rm -f "$dir/$2".mpg* "$dir/$2".stdout*
+	echo "$1" > "$dir/$2.same"
+}
+
+while read kind name rest; do
+	case $kind in
+	input)
+		$MPGGEN $rest -o "$dir/in/$name" 2> /dev/null ||
+			{ echo "mpggen $rest failed"; exit 1; }
+		;;
+	clip)
+		[ -n "$CHECKCLIPS" ] && [ -f "$CHECKCLIPS/$rest" ] &&
+			echo "$CHECKCLIPS/$rest" > "$dir/in/$name.clip"
+		;;
+	case)
+		eval "case_$name=\$rest"
+		run_case $name $rest
+		;;
+	resume)
+		ref=${rest%% *}
+		eval "run_case $name \$case_$ref ${rest#$ref}"
+		same "$ref" "$name"
+		;;
+	esac
+done < $GOLDEN/cases
+
+# every result file except the raw messages
+(cd "$dir" && for f in *; do
+	case $f in
+	in|times|skipped|sums*|*.err|*.dump) ;;
+	*) md5sum "$f" ;;
+	esac
+done) > "$dir/sums"
+
+total=0
+while read name t; do
+	total=$((total + t))
+done < "$dir/times"
+echo "total $total ms" >> "$dir/times"
+echo "total            $total ms"
+
+# golden lines of skipped cases are kept as they are
+skipped() {
+	[ -f "$dir/skipped" ] || return 1
+	while read n; do
+		case $1 in
+		$n.*|$n[0-9]*.*) return 0 ;;
+		esac
+	done < "$dir/skipped"
+	return 1
+}
+keep() {
+	while read sum f; do
+		skipped "$f" && echo "$sum  $f"
+	done
+}
+drop() {
+	while read sum f; do
+		skipped "$f" || echo "$sum  $f"
+	done
+}
+
+if [ $update = 1 ]; then
+	[ -f $GOLDEN/sums ] && keep < $GOLDEN/sums > "$dir/sums.keep"
+	cat "$dir/sums" "$dir/sums.keep" 2> /dev/null | sort -k 2 > $GOLDEN/sums
+	rm -f "$dir/sums.keep"
+	for f in $GOLDEN/*.dump; do
+		[ -f "$f" ] && ! skipped "${f#$GOLDEN/}" && rm -f "$f"
+	done
+	for f in "$dir"/*.dump; do
+		[ -f "$f" ] && cp "$f" $GOLDEN/
+	done
+	echo "updated $GOLDEN"
+	exit 0
+fi
+
+drop < $GOLDEN/sums | sort -k 2 > "$dir/sums.golden"
+sort -k 2 "$dir/sums" > "$dir/sums.new"
+if cmp -s "$dir/sums.golden" "$dir/sums.new"; then
+	rm -f "$dir/sums.golden" "$dir/sums.new"
+	echo "all results match $GOLDEN"
+	exit 0
+fi
+
+echo "results differ from $GOLDEN:"
+diff "$dir/sums.golden" "$dir/sums.new" | sed -n 's/^[<>] [0-9a-f]*  //p' |
+sort -u | while read f; do
+	echo "  $f"
+	if [ -f "$GOLDEN/$f.dump" ] && [ -f "$dir/$f.dump" ]; then
+		diff "$GOLDEN/$f.dump" "$dir/$f.dump" | head -10 |
+		sed 's/^/    /'
+	fi
+done
+exit 1
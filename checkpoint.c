@@ -0,0 +1,483 @@
+/*
+ * checkpoint.c: save and restore the state of a remux
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * Between two packs the whole state of a program is in its struct
+ * replex, its multiplex_t, its audio streams, the rings between
+ * read_pos and write_pos and the buffer of a PES parser with withbuf.
+ * Everything read from the input up to its offset has been parsed, so
+ * a resumed run reads on from there and writes the same output as an
+ * uninterrupted one. The pointers in the saved structs are replaced
+ * with those of the resumed run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "checkpoint.h"
+
+#ifndef O_LARGEFILE
+#define O_LARGEFILE 0
+#endif
+
+int checkpoint_resume = 0;
+int checkpoint_stop = 0;
+
+static char *name;       // <output>.ckp
+static char *newname;    // written first and renamed to name
+static uint64_t every;
+static uint64_t next_at[N_PROG];
+
+typedef struct ckpt_head_s{
+	char magic[4];
+	uint32_t version;
+	char replex[32];        // VERSION of the writer
+	uint32_t sizes[4];      // replex, multiplex_t, audio_stream_t, index_unit
+	uint32_t nprog;
+	uint64_t ring_clock;
+	uint64_t in_pos;        // offset in the current input file
+} ckpt_head;
+
+/* followed by the audio streams, the PES buffers and the rings */
+typedef struct ckpt_prog_s{
+	struct replex rx;
+	multiplex_t mx;
+	int32_t start;
+	int32_t done;
+	uint64_t out_len;
+} ckpt_prog;
+
+void checkpoint_init(const char *output, uint64_t e, int resume)
+{
+	int i;
+
+	if (!(name = malloc(strlen(output)+5)) ||
+	    !(newname = malloc(strlen(output)+9))){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+	sprintf(name, "%s.ckp", output);
+	sprintf(newname, "%s.ckp.new", output);
+	every = e;
+	checkpoint_resume = resume;
+	for (i=0; i < N_PROG; i++) next_at[i] = every;
+}
+
+/* at the start of a GOP, before any of it is written */
+int checkpoint_due(multiplex_t *mx, int i)
+{
+	index_unit *viu = &mx->viu;
+
+	if (!every || mx->total_written < next_at[i]) return 0;
+	return viu->frame_start && viu->seq_header && viu->gop &&
+		viu->frame == I_FRAME;
+}
+
+static int ck_write(int fd, void *buf, size_t len)
+{
+	uint8_t *b = buf;
+
+	while (len){
+		ssize_t w = write(fd, b, len);
+
+		if (w < 0){
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		b += w;
+		len -= w;
+	}
+	return 0;
+}
+
+static void ck_read(int fd, void *buf, size_t len)
+{
+	uint8_t *b = buf;
+
+	while (len){
+		ssize_t r = read(fd, b, len);
+
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0){
+			fprintf(stderr,"Checkpoint %s is truncated\n", name);
+			exit(1);
+		}
+		b += r;
+		len -= r;
+	}
+}
+
+static int save_ring(int fd, ringbuffer *rbuf)
+{
+	int avail = ring_avail(rbuf);
+	int first = rbuf->size - rbuf->read_pos;
+
+	if (first > avail) first = avail;
+	if (ck_write(fd, rbuf->buffer + rbuf->read_pos, first) < 0 ||
+	    ck_write(fd, rbuf->buffer, avail - first) < 0)
+		return -1;
+	return 0;
+}
+
+static int save_pes(int fd, pes_in_t *p)
+{
+	int found = p->found < PES_BUF_SIZE ? p->found : PES_BUF_SIZE;
+
+	if (!p->withbuf || found <= 0) return 0;
+	return ck_write(fd, p->buf, found);
+}
+
+static int save_program(int fd, struct replex *rx, multiplex_t *mx,
+			int start, int done)
+{
+	ckpt_prog p;
+	int i, n = rx->apidn + rx->ac3n;
+
+	memset(&p, 0, sizeof(p));
+	p.rx = *rx;
+	p.mx = *mx;
+	p.start = start;
+	p.done = done;
+	p.out_len = lseek(rx->fd_out, 0, SEEK_CUR);
+	if (ck_write(fd, &p, sizeof(p)) < 0) return -1;
+
+	if (rx->apidn &&
+	    ck_write(fd, rx->astream, rx->apidn*sizeof(audio_stream_t)) < 0)
+		return -1;
+	if (rx->ac3n &&
+	    ck_write(fd, rx->ac3stream, rx->ac3n*sizeof(audio_stream_t)) < 0)
+		return -1;
+
+	if (save_pes(fd, &rx->pvideo) < 0 ||
+	    save_ring(fd, &rx->vrbuffer) < 0 ||
+	    save_ring(fd, &rx->index_vrbuffer) < 0)
+		return -1;
+	for (i=0; i < n; i++){
+		audio_stream_t *as = i < rx->apidn ? &rx->astream[i] :
+			&rx->ac3stream[i - rx->apidn];
+
+		if (save_pes(fd, &as->pes) < 0 ||
+		    save_ring(fd, &as->rbuffer) < 0 ||
+		    save_ring(fd, &as->index_rbuffer) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* A failed checkpoint is reported and the remux goes on, the last
+   complete one stays in place. */
+void checkpoint_write(struct replex **rs, multiplex_t **mx, int *start,
+		      int *done, int n)
+{
+	ckpt_head head;
+	int fd, i;
+
+	for (i=0; i < n; i++) next_at[i] = mx[i]->total_written + every;
+
+	// the output has to be on disk before a checkpoint refers to it
+	for (i=0; i < n; i++)
+		if (fdatasync(rs[i]->fd_out) < 0){
+			perror("Error writing checkpoint");
+			return;
+		}
+
+	if ((fd = open(newname, O_WRONLY|O_CREAT|O_TRUNC|O_LARGEFILE,
+		       S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) < 0){
+		perror("Error writing checkpoint");
+		return;
+	}
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, CKPT_MAGIC, 4);
+	head.version = CKPT_VERSION;
+	strncpy(head.replex, VERSION, sizeof(head.replex)-1);
+	head.sizes[0] = sizeof(struct replex);
+	head.sizes[1] = sizeof(multiplex_t);
+	head.sizes[2] = sizeof(audio_stream_t);
+	head.sizes[3] = sizeof(index_unit);
+	head.nprog = n;
+	head.ring_clock = ring_clock;
+	head.in_pos = lseek(rs[0]->fd_in, 0, SEEK_CUR);
+
+	if (ck_write(fd, &head, sizeof(head)) < 0) goto error;
+	for (i=0; i < n; i++)
+		if (save_program(fd, rs[i], mx[i], start[i], done[i]) < 0)
+			goto error;
+	if (fsync(fd) < 0) goto error;
+	close(fd);
+	if (rename(newname, name) < 0){
+		perror("Error writing checkpoint");
+		unlink(newname);
+	} else if (checkpoint_stop){
+		fprintf(stderr,"Stopped after checkpoint %s\n", name);
+		exit(0);
+	}
+	return;
+
+error:
+	perror("Error writing checkpoint");
+	close(fd);
+	unlink(newname);
+}
+
+static void ring_size(ringbuffer *run, ringbuffer *saved)
+{
+	if (run->size != saved->size){
+		fprintf(stderr,"Checkpoint %s was written with other buffer sizes (-g)\n", name);
+		exit(1);
+	}
+	saved->buffer = run->buffer;
+}
+
+/* the units refer to the fill frame of their stream and carry the
+   arrival time of the interrupted run */
+static void fix_unit(index_unit *iu, uint8_t *fillframe)
+{
+	if (iu->fillframe) iu->fillframe = fillframe;
+	iu->arrival = 0;
+}
+
+static void load_ring(int fd, ringbuffer *rbuf, int index, uint8_t *fillframe)
+{
+	int avail = ring_avail(rbuf);
+	int first = rbuf->size - rbuf->read_pos;
+	int off;
+
+	if (first > avail) first = avail;
+	ck_read(fd, rbuf->buffer + rbuf->read_pos, first);
+	ck_read(fd, rbuf->buffer, avail - first);
+	if (!index) return;
+
+	for (off = 0; off + sizeof(index_unit) <= avail;
+	     off += sizeof(index_unit)){
+		index_unit iu;
+		int pos = (rbuf->read_pos + off) % rbuf->size;
+		int l = rbuf->size - pos;
+
+		ring_peek(rbuf, (uint8_t *)&iu, sizeof(iu), off);
+		fix_unit(&iu, fillframe);
+		if (l > sizeof(iu)) l = sizeof(iu);
+		memcpy(rbuf->buffer + pos, &iu, l);
+		memcpy(rbuf->buffer, (uint8_t *)&iu + l, sizeof(iu) - l);
+	}
+}
+
+static void load_pes(int fd, pes_in_t *p)
+{
+	int found = p->found < PES_BUF_SIZE ? p->found : PES_BUF_SIZE;
+
+	if (p->withbuf && found > 0) ck_read(fd, p->buf, found);
+}
+
+static void load_audio(int fd, audio_stream_t *as)
+{
+	audio_stream_t run = *as;
+
+	ck_read(fd, as, sizeof(*as));
+	as->pes.buf = run.pes.buf;
+	as->pes.rbuf = run.pes.rbuf;
+	as->pes.priv = run.pes.priv;
+	ring_size(&run.rbuffer, &as->rbuffer);
+	ring_size(&run.index_rbuffer, &as->index_rbuffer);
+	fix_unit(&as->iu, as->fillframe);
+	fix_unit(&as->current_index, as->fillframe);
+}
+
+static void load_replex(struct replex *rx, struct replex *c)
+{
+	struct replex run = *rx;
+
+	if (c->itype != run.itype || c->otype != run.otype ||
+	    c->vpid != run.vpid || c->apidn != run.apidn ||
+	    c->ac3n != run.ac3n){
+		fprintf(stderr,"Checkpoint %s does not fit these options\n",
+			name);
+		exit(1);
+	}
+	ring_size(&run.vrbuffer, &c->vrbuffer);
+	ring_size(&run.index_vrbuffer, &c->index_vrbuffer);
+
+	*rx = *c;
+	// what belongs to this run
+	rx->fd_in = run.fd_in;
+	rx->fd_out = run.fd_out;
+	rx->ac = run.ac;
+	rx->astream = run.astream;
+	rx->ac3stream = run.ac3stream;
+	rx->pvideo.buf = run.pvideo.buf;
+	rx->pvideo.rbuf = run.pvideo.rbuf;
+	rx->pvideo.priv = run.pvideo.priv;
+	rx->priv = run.priv;
+	rx->inputFiles = run.inputFiles;
+	rx->follow = run.follow;
+	rx->follow_fd = run.follow_fd;
+	rx->follow_closed = run.follow_closed;
+	rx->next = run.next;
+	rx->in = run.in;
+	rx->pidmap = run.pidmap;
+}
+
+static void load_mux(multiplex_t *mx, multiplex_t *c, struct replex *rx)
+{
+	multiplex_t run = *mx;
+
+	*mx = *c;
+	mx->fd_out = rx->fd_out;
+	mx->astream = rx->astream;
+	mx->ac3stream = rx->ac3stream;
+	mx->vrbuffer = &rx->vrbuffer;
+	mx->index_vrbuffer = &rx->index_vrbuffer;
+	mx->fill_buffers = run.fill_buffers;
+	mx->priv = run.priv;
+	fix_unit(&mx->viu, NULL);
+}
+
+static void load_output(struct replex *rx, uint64_t len)
+{
+	struct stat st;
+
+	if (fstat(rx->fd_out, &st) < 0 || st.st_size < len){
+		fprintf(stderr,"Output is shorter than at the checkpoint\n");
+		exit(1);
+	}
+	if (ftruncate(rx->fd_out, len) < 0 ||
+	    lseek(rx->fd_out, len, SEEK_SET) < 0){
+		perror("Error truncating output");
+		exit(1);
+	}
+}
+
+static void load_input(struct replex *rx, uint64_t pos)
+{
+	int i;
+
+	for (i=0; rx->inputFiles && rx->inputFiles[i]; i++);
+	if (rx->inputIdx >= i){
+		fprintf(stderr,"Checkpoint %s needs more input files\n", name);
+		exit(1);
+	}
+	if (rx->inputIdx){
+		close(rx->fd_in);
+		if ((rx->fd_in = open(rx->inputFiles[rx->inputIdx],
+				      O_RDONLY|O_LARGEFILE)) < 0){
+			fprintf(stderr,"Error opening input file %s",
+				rx->inputFiles[rx->inputIdx]);
+			exit(1);
+		}
+	}
+	rx->inflength = lseek(rx->fd_in, 0, SEEK_END);
+	if (rx->inflength < pos){
+		fprintf(stderr,"Input %s is shorter than at the checkpoint\n",
+			rx->inputFiles[rx->inputIdx]);
+		exit(1);
+	}
+	lseek(rx->fd_in, pos, SEEK_SET);
+	fprintf(stderr,"Resuming %s at %.2f MB\n",
+		rx->inputFiles[rx->inputIdx], pos/1024./1024.);
+}
+
+/* instead of the start of the multiplexers, mx[i]->priv and
+   fill_buffers are set */
+void checkpoint_load(struct replex **rs, multiplex_t **mx, int *start,
+		     int *done, int n)
+{
+	ckpt_head head;
+	ckpt_prog *p;
+	int fd, i, j;
+
+	if ((fd = open(name, O_RDONLY|O_LARGEFILE)) < 0){
+		perror("Error opening checkpoint");
+		exit(1);
+	}
+	ck_read(fd, &head, sizeof(head));
+	if (memcmp(head.magic, CKPT_MAGIC, 4) ||
+	    head.version != CKPT_VERSION){
+		fprintf(stderr,"%s is no checkpoint\n", name);
+		exit(1);
+	}
+	if (strncmp(head.replex, VERSION, sizeof(head.replex)) ||
+	    head.sizes[0] != sizeof(struct replex) ||
+	    head.sizes[1] != sizeof(multiplex_t) ||
+	    head.sizes[2] != sizeof(audio_stream_t) ||
+	    head.sizes[3] != sizeof(index_unit)){
+		fprintf(stderr,"Checkpoint %s was written by another replex (%.31s)\n",
+			name, head.replex);
+		exit(1);
+	}
+	if (head.nprog != n){
+		fprintf(stderr,"Checkpoint %s does not fit these options\n",
+			name);
+		exit(1);
+	}
+	if (!(p = malloc(sizeof(ckpt_prog)))){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+
+	for (i=0; i < n; i++){
+		struct replex *rx = rs[i];
+		int na;
+
+		ck_read(fd, p, sizeof(ckpt_prog));
+		load_replex(rx, &p->rx);
+		load_mux(mx[i], &p->mx, rx);
+		start[i] = p->start;
+		done[i] = p->done;
+		next_at[i] = mx[i]->total_written + every;
+		load_output(rx, p->out_len);
+
+		na = rx->apidn + rx->ac3n;
+		for (j=0; j < rx->apidn; j++) load_audio(fd, &rx->astream[j]);
+		for (j=0; j < rx->ac3n; j++) load_audio(fd, &rx->ac3stream[j]);
+
+		load_pes(fd, &rx->pvideo);
+		load_ring(fd, &rx->vrbuffer, 0, NULL);
+		load_ring(fd, &rx->index_vrbuffer, 1, NULL);
+		for (j=0; j < na; j++){
+			audio_stream_t *as = j < rx->apidn ? &rx->astream[j] :
+				&rx->ac3stream[j - rx->apidn];
+
+			load_pes(fd, &as->pes);
+			load_ring(fd, &as->rbuffer, 0, NULL);
+			load_ring(fd, &as->index_rbuffer, 1, as->fillframe);
+		}
+	}
+	free(p);
+	close(fd);
+
+	ring_clock = head.ring_clock;
+	load_input(rs[0], head.in_pos);
+}
+
+/* a finished remux needs no checkpoint */
+void checkpoint_finish(void)
+{
+	if (name) unlink(name);
+}
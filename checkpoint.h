@@ -0,0 +1,51 @@
+/*
+ * checkpoint.h
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <stdint.h>
+#include "replex.h"
+
+/* A checkpoint holds the state of all programs, the pending contents
+   of their rings, the input offset and the output lengths. It is a
+   memory image, only the same replex binary with the same options can
+   resume from it. */
+#define CKPT_MAGIC    "RXCP"
+#define CKPT_VERSION  1
+
+extern int checkpoint_resume;   // -R
+extern int checkpoint_stop;     // -X
+
+/* every is the output in bytes between checkpoints, 0 for none */
+void checkpoint_init(const char *output, uint64_t every, int resume);
+int checkpoint_due(multiplex_t *mx, int i);
+void checkpoint_write(struct replex **rs, multiplex_t **mx, int *start,
+		      int *done, int n);
+void checkpoint_load(struct replex **rs, multiplex_t **mx, int *start,
+		     int *done, int n);
+void checkpoint_finish(void);
+
+#endif /*_CHECKPOINT_H_*/
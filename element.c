@@ -360,15 +360,21 @@ int get_video_info(ringbuffer *rbuf, sequence_t *s, long off, int le)
 	return c;
 }
 
+/* Once a stream is locked on, the next frame starts right at off, so the
+   sync word is checked there first. Only on a mismatch the ring is
+   searched, in snippets, with memchr for the first sync byte. The
+   snippets start small and grow, callers step over false syncs one at
+   a time and must not pay for a full snippet each time. */
+#define SYNC_SNIP 4096
+#define SYNC_SNIP_MIN 16
 int find_audio_sync(ringbuffer *rbuf, uint8_t *buf, long off, int type, int le)
 {
-	int found = 0;
+	uint8_t snip[SYNC_SNIP];
 	int c=0;
 	int l;
+	int ssize = SYNC_SNIP_MIN;
 	uint8_t b1,b2,m2;
-	int r=0;
 
-	memset(buf,0,7);
 	b1 = 0x00;
 	b2 = 0x00;
 	m2 = 0xFF;
@@ -389,27 +395,37 @@ int find_audio_sync(ringbuffer *rbuf, uint8_t *buf, long off, int type, int le)
 	default:
 		return -1;
 	}
+	memset(buf,0,l);
+
+	if (le >= 2 && ring_peek(rbuf, buf, l, off) >= 0 &&
+	    buf[0] == b1 && (buf[1]&m2) == b2)
+		return 0;
 
 	c = off;
 	while ( c-off < le){
-		uint8_t b;
-		if ((r = mring_peek(rbuf, &b, 1, c)) <0) return -1;
-		switch(found){
-
-		case 0:
-			if ( b == b1) found = 1;
+		int n = le-(c-off);
+		uint8_t *p, *q;
+
+		if (n > ssize) n = ssize;
+		if (ssize < SYNC_SNIP) ssize *= 2;
+		if (ring_peek(rbuf, snip, n, c) < 0) return -1;
+
+		p = snip;
+		while ((q = memchr(p, b1, snip+n-p))){
+			if (q+1 == snip+n) break;
+			if ((q[1]&m2) == b2){
+				c += q-snip;
+				mring_peek(rbuf, buf, l, c);
+				return c-off;
+			}
+			p = q+1;
+		}
+		if (c-off+n == le){
+			if (snip[n-1] == b1) return -2;
 			break;
-			
-		case 1:
-			if ( (b&m2) == b2){
-				if ((r = mring_peek(rbuf, buf, l, c-1)) < -1) 
-					return -2;
-				return c-1-off;	
-			} else if ( b != b1) found = 0;
 		}
-		c++;
+		c += n-1;
 	}	
-	if (found) return -2;
 	return -1;
 }
 
@@ -515,7 +531,7 @@ int check_audio_header(ringbuffer *rbuf, audio_frame_t * af, long  off, int le,
 				return -1;
 			}
 		}
-                if ( af->bit_rate !=
+                if ( (headr[2] >> 4) == 0xf || af->bit_rate !=
                      (  af->bit_rate = bitrates[af->lsf][af->layer-1][(headr[2] >> 4 )]*1000)){
 #ifdef IN_DEBUG
                         fprintf(stderr,"Wrong audio bit rate\n");
@@ -545,6 +561,7 @@ int check_audio_header(ringbuffer *rbuf, audio_frame_t * af, long  off, int le,
 #endif
 			return -1;
 		}
+		if ((headr[5] >> 3) >= sizeof(ac3half)) return -1;
 		half = ac3half[headr[5] >> 3];
 		fr = (headr[4] & 0xc0) >> 6;
 		if (af->frequency != ((ac3_freq[fr] *100) >> half)){
@@ -575,7 +592,7 @@ int get_audio_info(ringbuffer *rbuf, audio_frame_t *af, long off, int le, int ve
 		return c;
 
         af->layer = 4 - ((headr[1] & 0x06) >> 1);
-//        if (af->layer >3) return -1;
+        if (af->layer >3) return -1;
 
         if (DEBUG && verb)
 		fprintf(stderr,"Audiostream: layer: %d", af->layer);
@@ -597,7 +614,8 @@ int get_audio_info(ringbuffer *rbuf, audio_frame_t *af, long off, int le, int ve
 
 	af->padding = (headr[2] >> 1) & 1;
 
-
+	/* free format and the reserved index have no frame size */
+	if ((headr[2] >> 4) == 0 || (headr[2] >> 4) == 0xf) return -1;
         af->bit_rate = bitrates[af->lsf][af->layer-1][(headr[2] >> 4 )]*1000;
 
 
@@ -649,6 +667,9 @@ int get_ac3_info(ringbuffer *rbuf, audio_frame_t *af, long off, int le, int verb
 
 	if (DEBUG && verb) fprintf (stderr,"AC3 stream:");
 	frame = (headr[4]&0x3F);
+	if (!ac3_bitrates[frame>>1] || (headr[4] & 0xc0) == 0xc0 ||
+	    (headr[5] >> 3) >= sizeof(ac3half))
+		return -1;
 	af->bit_rate = ac3_bitrates[frame>>1]*1000;
 	half = ac3half[headr[5] >> 3];
 	if (DEBUG && verb) fprintf (stderr,"  bit rate: %d kb/s", af->bit_rate/1000);
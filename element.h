@@ -128,6 +128,11 @@ struct audio_frame_s{
 	
 } audio_frame_t;
 
+extern const uint16_t bitrates[2][3][15];
+extern const uint16_t freqs[3];
+extern unsigned int ac3_bitrates[32];
+extern uint32_t ac3_freq[4];
+
 void pts2time(uint64_t pts, uint8_t *buf, int len);
 int find_audio_sync(ringbuffer *rbuf, uint8_t *buf, long off, int type, int le);
 int find_audio_s(uint8_t *rbuf, long off, int type, int le);
@@ -0,0 +1,580 @@
+/*
+ * fuzz.c: fuzzing entry points for the input parsers
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * The library is built with -DREPLEX_FUZZ, so the parsers add the bytes
+ * they copy or scan to fuzz_work. An input that needs more than
+ * FUZZ_PER_BYTE units of work per byte is a finding, just like a crash.
+ * exit() is redirected to fuzz_exit(), giving up on broken input is
+ * allowed.
+ *
+ * With -DFUZZ_TARGET=<n> and -fsanitize=fuzzer this is the libFuzzer
+ * target for one parser. Without it, it is a driver that runs saved
+ * inputs (named <target>-...) or random ones against all parsers.
+ *
+ * The first two bytes of an input are not stream data: byte 0 holds
+ * flags, byte 1 the size of the pieces the data is handed over in.
+ */
+
+#undef exit
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "replex.h"
+#include "pes.h"
+#include "fuzz.h"
+
+void es_out(pes_in_t *p);
+
+#define FUZZ_PER_BYTE 64
+#define FUZZ_SLACK    (256*1024)
+#define FUZZ_MAX      (1024*1024)
+
+#define F_WITHBUF  0x01   /* get_pes: PS style with its own buffer */
+#define F_AC3      0x02   /* audio: AC3 instead of MPEG audio */
+#define F_PTS      0x04   /* video/audio: PES has a PTS (and DTS) */
+#define F_IGNORE   0x08   /* -f */
+#define F_KEEP     0x10   /* -k */
+#define F_ANALYZE  0x20   /* -y */
+
+enum { T_GET_PES, T_GET_AVI, T_ANALYZE_VIDEO, T_ANALYZE_AUDIO,
+       T_AUDIO_SYNC, T_N };
+
+uint64_t fuzz_work;
+uint64_t fuzz_budget = ~0ULL;
+static jmp_buf fuzz_env;
+static int in_target;
+
+void fuzz_exit(int status)
+{
+	if (in_target) longjmp(fuzz_env, 1);
+	exit(status);
+}
+
+void fuzz_over_budget(void)
+{
+#ifdef FUZZ_TARGET
+	fprintf(stderr,"work budget exceeded: %llu\n",
+		(unsigned long long)fuzz_work);
+	abort();
+#else
+	longjmp(fuzz_env, 2);
+#endif
+}
+
+static struct replex rx;
+static audio_stream_t astream;
+static pes_in_t pes;
+static ringbuffer rbuf;
+
+#define FUZZ_VIDEO_BUF (2*1024*1024)
+#define FUZZ_AUDIO_BUF (512*1024)
+
+static void setup(void)
+{
+	static int done = 0;
+
+	if (done) return;
+	ring_init(&rbuf, 2*MMAX_PLENGTH);
+	ring_init(&rx.vrbuffer, FUZZ_VIDEO_BUF);
+	ring_init(&rx.index_vrbuffer, INDEX_BUF);
+	ring_init(&astream.rbuffer, FUZZ_AUDIO_BUF);
+	ring_init(&astream.index_rbuffer, INDEX_BUF);
+	done = 1;
+}
+
+/* forget everything but the buffers */
+static void reset(int flags)
+{
+	ringbuffer vr = rx.vrbuffer, vi = rx.index_vrbuffer;
+	ringbuffer ar = astream.rbuffer, ai = astream.index_rbuffer;
+	uint8_t *pbuf = pes.buf;
+
+	memset(&rx, 0, sizeof(rx));
+	memset(&astream, 0, sizeof(astream));
+	memset(&pes, 0, sizeof(pes));
+	rx.vrbuffer = vr;
+	rx.index_vrbuffer = vi;
+	astream.rbuffer = ar;
+	astream.index_rbuffer = ai;
+	pes.buf = pbuf;
+	ring_clear(&rbuf);
+	ring_clear(&rx.vrbuffer);
+	ring_clear(&rx.index_vrbuffer);
+	ring_clear(&astream.rbuffer);
+	ring_clear(&astream.index_rbuffer);
+
+	rx.videobuf = FUZZ_VIDEO_BUF;
+	rx.audiobuf = FUZZ_AUDIO_BUF;
+	rx.ac3buf = FUZZ_AUDIO_BUF;
+	rx.ignore_pts = !!(flags & F_IGNORE);
+	rx.keep_pts = !!(flags & F_KEEP);
+	rx.analyze = flags & F_ANALYZE ? 2 : 0;
+	rx.vpid = 0xE0;
+	init_index(&rx.current_vindex);
+
+	astream.type = flags & F_AC3 ? AC3 : MPEG_AUDIO;
+	astream.state = S_SEARCH;
+	init_index(&astream.current_index);
+	/* get_avi always writes audio to astream[0] */
+	rx.astream = &astream;
+	rx.ac3stream = &astream;
+	if (flags & F_AC3) rx.ac3n = 1;
+	else rx.apidn = 1;
+}
+
+static void drop_pes(pes_in_t *p)
+{
+	if (!p->withbuf) ring_clear(p->rbuf);
+}
+
+static void drop_avi(pes_in_t *p)
+{
+	ring_clear(&rx.vrbuffer);
+	ring_clear(&astream.rbuffer);
+}
+
+/* keep only what the analysis may come back to */
+static void consume(ringbuffer *r, ringbuffer *index, int abort)
+{
+	int n = ring_avail(r) - abort;
+
+	if (n > 0) ring_skip(r, n);
+	ring_clear(index);
+}
+
+static void feed_es(int type, ringbuffer *r, const uint8_t *data, int len,
+		    int flags)
+{
+	pes.type = type;
+	pes.priv = &rx;
+	pes.ini_pos = ring_wpos(r);
+	pes.hlength = 0;
+	pes.plength = len + 3;
+	pes.flag2 = 0;
+	if (flags & F_PTS){
+		static uint64_t pts = 90000;
+		uint8_t *t = pes.pts;
+
+		pes.flag2 = type == 0xE0 ? PTS_DTS : PTS_ONLY;
+		pts += 3600 + (len & 0xFF);
+		t[0] = 0x21 | ((pts >> 29) & 0x0E);
+		t[1] = pts >> 22;
+		t[2] = 0x01 | ((pts >> 14) & 0xFE);
+		t[3] = pts >> 7;
+		t[4] = 0x01 | ((pts << 1) & 0xFE);
+		memcpy(pes.dts, pes.pts, 5);
+	}
+	if (ring_write(r, (uint8_t *)data, len) < 0) return;
+	es_out(&pes);
+}
+
+static void run_target(int t, const uint8_t *data, size_t size)
+{
+	int flags = data[0];
+	int piece = data[1] < 64 ? data[1]+1 : (data[1]-63)*256;
+	const uint8_t *d = data+2;
+	int len = size-2;
+	int c;
+
+	reset(flags);
+	switch (t){
+	case T_GET_PES:
+		if (flags & F_WITHBUF)
+			init_pes_in(&pes, 0, NULL, 1);
+		else
+			init_pes_in(&pes, 0xE0, &rbuf, 0);
+		pes.priv = &rx;
+		for (c = 0; c < len; c += piece)
+			get_pes(&pes, (uint8_t *)d+c,
+				len-c < piece ? len-c : piece, drop_pes);
+		break;
+
+	case T_GET_AVI:
+		init_pes_in(&pes, 0, NULL, 0);
+		pes.priv = &rx;
+		for (c = 0; c < len; c += piece)
+			get_avi(&pes, (uint8_t *)d+c,
+				len-c < piece ? len-c : piece, drop_avi);
+		break;
+
+	case T_ANALYZE_VIDEO:
+		for (c = 0; c < len; c += piece){
+			feed_es(0xE0, &rx.vrbuffer, d+c,
+				len-c < piece ? len-c : piece, flags);
+			consume(&rx.vrbuffer, &rx.index_vrbuffer,
+				rx.vpes_abort);
+		}
+		break;
+
+	case T_ANALYZE_AUDIO:
+		for (c = 0; c < len; c += piece){
+			feed_es(flags & F_AC3 ? 0x80 : 1, &astream.rbuffer,
+				d+c, len-c < piece ? len-c : piece, flags);
+			consume(&astream.rbuffer, &astream.index_rbuffer,
+				astream.pes_abort);
+		}
+		break;
+
+	case T_AUDIO_SYNC:{
+		uint8_t buf[7];
+		int type = flags & F_AC3 ? AC3 : MPEG_AUDIO;
+		int pos;
+
+		if (ring_write(&astream.rbuffer, (uint8_t *)d, len) < 0)
+			break;
+		/* step over false syncs like analyze_audio does */
+		for (c = 0; c < len; c += pos+1)
+			if ((pos = find_audio_sync(&astream.rbuffer, buf, c,
+						   type, len-c)) < 0)
+				break;
+		break;
+	}
+	}
+}
+
+/* 0 if fine, 1 if the parser gave up with exit(), 2 if over budget */
+static int fuzz_one(int t, const uint8_t *data, size_t size)
+{
+	int re;
+
+	if (size < 2 || size > FUZZ_MAX) return 0;
+	setup();
+	fuzz_work = 0;
+	fuzz_budget = (uint64_t)FUZZ_PER_BYTE*size + FUZZ_SLACK;
+	in_target = 1;
+	if (!(re = setjmp(fuzz_env)))
+		run_target(t, data, size);
+	in_target = 0;
+	return re;
+}
+
+#ifdef FUZZ_TARGET
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	fuzz_one(FUZZ_TARGET, data, size);
+	return 0;
+}
+
+#else
+
+static char *target_names[T_N] = {
+	"get_pes", "get_avi", "analyze_video", "analyze_audio", "audio_sync"
+};
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+	seed = seed*1103515245 + 12345;
+	return ((seed >> 8) & 0xffffff) % n;
+}
+
+/* random input built from the pieces the parsers look for */
+static int make_input(uint8_t *buf, int max)
+{
+	static const uint8_t codes[] = {
+		0x00, 0x01, 0xAF, 0xB2, 0xB3, 0xB5, 0xB7, 0xB8,
+		0xBA, 0xBB, 0xBD, 0xBE, 0xBF, 0xC0, 0xE0, 0xFF
+	};
+	int n = 0, last = 0, lastlen = 0;
+	int size = 2 + rnd(rnd(2) ? 4096 : max-2);
+
+	buf[n++] = rnd(256);
+	buf[n++] = rnd(256);
+	while (n < size){
+		int start = n, i, l;
+
+		switch (rnd(10)){
+		case 0:
+			l = 1 + rnd(64);
+			for (i = 0; i < l && n < size; i++) buf[n++] = rnd(256);
+			break;
+		case 1:
+		case 2:
+			if (n+4 > size) { n = size; break; }
+			buf[n++] = 0;
+			buf[n++] = 0;
+			buf[n++] = 1;
+			buf[n++] = codes[rnd(sizeof(codes))];
+			break;
+		case 3:
+			if (n+9 > size) { n = size; break; }
+			buf[n++] = 0;
+			buf[n++] = 0;
+			buf[n++] = 1;
+			buf[n++] = rnd(2) ? 0xE0 : rnd(2) ? 0xC0 : 0xBD;
+			buf[n++] = rnd(2) ? 0 : rnd(256);
+			buf[n++] = rnd(256);
+			buf[n++] = 0x80 | rnd(2);
+			buf[n++] = rnd(4) << 6;
+			buf[n++] = rnd(2) ? 10 : rnd(256);
+			break;
+		case 4:
+			if (n+4 > size) { n = size; break; }
+			buf[n++] = 0xFF;
+			buf[n++] = 0xF8 | rnd(8);
+			buf[n++] = rnd(256);
+			buf[n++] = rnd(256);
+			break;
+		case 5:
+			if (n+6 > size) { n = size; break; }
+			buf[n++] = 0x0B;
+			buf[n++] = 0x77;
+			for (i = 0; i < 4; i++) buf[n++] = rnd(256);
+			break;
+		case 6:
+			if (n+8 > size) { n = size; break; }
+			memcpy(buf+n, rnd(2) ? "00dc" : "01wb", 4);
+			n += 4;
+			l = rnd(2) ? rnd(16) : rnd(0x20000);
+			for (i = 0; i < 4; i++, l >>= 8) buf[n++] = l;
+			break;
+		case 7:
+			l = 1 + rnd(256);
+			memset(buf+n, rnd(2) ? 0x00 : 0xFF,
+			       n+l > size ? size-n : l);
+			n = n+l > size ? size : n+l;
+			break;
+		default:
+			/* repeat the last piece, that is where rescans hurt */
+			if (!lastlen) break;
+			l = rnd(4096);
+			for (i = 0; i < l && n+lastlen <= size; i++){
+				memmove(buf+n, buf+last, lastlen);
+				n += lastlen;
+			}
+			if (i < l) n = size;
+			continue;
+		}
+		last = start;
+		lastlen = n-start;
+	}
+	return n;
+}
+
+/* like libFuzzer, hand over an exact copy so that reads past the end
+   are caught with -fsanitize=address */
+static int fuzz_copy(int t, uint8_t *buf, int size)
+{
+	uint8_t *data;
+	int re;
+
+	if (!(data = malloc(size))){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+	memcpy(data, buf, size);
+	re = fuzz_one(t, data, size);
+	free(data);
+	return re;
+}
+
+static void save(char *name, uint8_t *buf, int size)
+{
+	FILE *f;
+
+	if (!(f = fopen(name, "w"))){
+		perror(name);
+		exit(1);
+	}
+	fwrite(buf, 1, size, f);
+	fclose(f);
+}
+
+static int target_of(char *name)
+{
+	char *base = strrchr(name, '/');
+	int t;
+
+	base = base ? base+1 : name;
+	for (t = 0; t < T_N; t++){
+		int l = strlen(target_names[t]);
+		if (!strncmp(base, target_names[t], l) && base[l] == '-')
+			return t;
+	}
+	return -1;
+}
+
+static int run_file(char *name, int t, uint8_t *buf)
+{
+	FILE *f;
+	int size, re;
+
+	if (t < 0 && (t = target_of(name)) < 0){
+		fprintf(stderr,"%s: unknown target\n", name);
+		return 1;
+	}
+	if (!(f = fopen(name, "r"))){
+		perror(name);
+		return 1;
+	}
+	size = fread(buf, 1, FUZZ_MAX, f);
+	fclose(f);
+
+	re = fuzz_copy(t, buf, size);
+	printf("%-40s %-14s %8d bytes %6.1f/byte%s\n", name,
+	       target_names[t], size,
+	       size ? (double)fuzz_work/size : 0,
+	       re == 2 ? "  OVER BUDGET" : re == 1 ? "  (exit)" : "");
+	return re == 2;
+}
+
+static void usage(char *progname)
+{
+        printf ("usage: %s [options] [<input files or directories>]\n\n",progname);
+        printf ("options:\n");
+        printf ("  --help,             -h            :  print help message\n");
+        printf ("\n");
+        printf ("  --runs,             -n <integer>  :  number of random inputs per target\n");
+        printf ("  --of,               -o <string>   :  directory for inputs that are over budget (default .)\n");
+        printf ("  --seed,             -s <integer>  :  seed for the random inputs (default 1)\n");
+        printf ("  --target,           -t <string>   :  only this target (get_pes, get_avi, analyze_video,\n");
+        printf ("                                       analyze_audio, audio_sync)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *buf;
+	char *dir = ".";
+	int runs = 0;
+	int target = -1;
+	int found = 0;
+	int c, t, i;
+
+        while (1){
+                int option_index = 0;
+                static struct option long_options[] = {
+			{"help", no_argument , NULL, 'h'},
+			{"runs", required_argument, NULL, 'n'},
+			{"of", required_argument, NULL, 'o'},
+			{"seed", required_argument, NULL, 's'},
+			{"target", required_argument, NULL, 't'},
+			{0, 0, 0, 0}
+		};
+                c = getopt_long (argc, argv, "hn:o:s:t:",
+                                 long_options, &option_index);
+                if (c == -1)
+                        break;
+
+                switch (c){
+                case 'n':
+			runs = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'o':
+			dir = optarg;
+			break;
+                case 's':
+			seed = strtoul(optarg,(char **)NULL, 0);
+			break;
+                case 't':
+			for (target = 0; target < T_N; target++)
+				if (!strcmp(optarg, target_names[target]))
+					break;
+			if (target == T_N) usage(argv[0]);
+			break;
+                case 'h':
+                case '?':
+                default:
+                        usage(argv[0]);
+                }
+        }
+	if (optind == argc && !runs) usage(argv[0]);
+
+	if (!(buf = malloc(FUZZ_MAX))){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+
+	for (; optind < argc; optind++){
+		struct stat st;
+		struct dirent **e;
+		int n;
+
+		if (stat(argv[optind], &st) < 0 || !S_ISDIR(st.st_mode)){
+			found += run_file(argv[optind], target, buf);
+			continue;
+		}
+		if ((n = scandir(argv[optind], &e, NULL, alphasort)) < 0){
+			perror(argv[optind]);
+			continue;
+		}
+		for (i = 0; i < n; i++){
+			char name[1024];
+
+			if (e[i]->d_name[0] != '.'){
+				snprintf(name, sizeof(name), "%s/%s",
+					 argv[optind], e[i]->d_name);
+				found += run_file(name, target, buf);
+			}
+			free(e[i]);
+		}
+		free(e);
+	}
+
+	for (t = 0; t < T_N; t++){
+		uint32_t s = seed;
+		double worst = 0;
+
+		if (!runs || (target >= 0 && t != target)) continue;
+		for (i = 0; i < runs; i++){
+			int size = make_input(buf, FUZZ_MAX);
+			char name[1024];
+			double w;
+			int re;
+
+			/* stays there if the parser crashes */
+			snprintf(name, sizeof(name), "%s/%s-%u-%d", dir,
+				 target_names[t], s, i);
+			save(name, buf, size);
+			re = fuzz_copy(t, buf, size);
+			w = (double)fuzz_work/size;
+			if (re != 2){
+				if (w > worst) worst = w;
+				unlink(name);
+				continue;
+			}
+			printf("%s: over budget\n", name);
+			found++;
+		}
+		printf("%-14s %d inputs, worst %.1f/byte\n", target_names[t],
+		       runs, worst);
+	}
+	free(buf);
+
+	return found ? 1 : 0;
+}
+
+#endif
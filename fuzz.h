@@ -0,0 +1,44 @@
+/*
+ * fuzz.h
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef _FUZZ_H_
+#define _FUZZ_H_
+
+#include <stdint.h>
+
+/* work done by the parsers, counted only in the fuzzing build (fuzz.c)
+   to find input that makes them super-linear */
+#ifdef REPLEX_FUZZ
+extern uint64_t fuzz_work;
+extern uint64_t fuzz_budget;
+void fuzz_over_budget(void);
+#define FUZZ_WORK(n) do { fuzz_work += (n); \
+		if (fuzz_work > fuzz_budget) fuzz_over_budget(); } while (0)
+#else
+#define FUZZ_WORK(n) do {} while (0)
+#endif
+
+#endif /*_FUZZ_H_*/
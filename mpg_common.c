@@ -27,6 +27,8 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "element.h"
 #include "pes.h"
 #include "ts.h"
@@ -378,6 +380,54 @@ int ring_find_any_headerx(ringbuffer *rbuf, uint8_t *head, int off, int le)
 	else return -1;
 }
 
+/* Like ring_find_any_header, but slice start codes are stepped over, so
+   the scan only stops at sequence, GOP, picture, extension and end
+   codes. The 0x01 bytes are located with memchr over snippets that
+   start small and grow, so that headers close together don't cost a
+   full snippet each. */
+#define SCAN_SIZE (16*1024)
+#define SCAN_SIZE_MIN 64
+int ring_find_nonslice_header(ringbuffer *rbuf, uint8_t *head, int off, int le)
+{
+	uint8_t buf[SCAN_SIZE];
+	int n=off;
+	int snip;
+	int ssize = SCAN_SIZE_MIN;
+
+	while(le > 3) {
+		uint8_t *p, *q, *end;
+
+		snip = le > ssize ? ssize : le;
+		if (ssize < SCAN_SIZE) ssize *= 2;
+		if (ring_peek(rbuf, buf, snip, n) < 0)
+			return -1;
+
+		p = buf+2;
+		end = buf+snip-1; // the byte after 00 00 01 must be in buf
+		while (p < end && (q = memchr(p, 0x01, end-p))){
+			if (!q[-1] && !q[-2] && 
+			    (q[1] >= EXCEPT_SLICE || 
+			     q[1] == PICTURE_START_CODE)){
+				*head = q[1];
+				return n+(q-2-buf)-off;
+			}
+			p = q+1;
+		}
+		if (snip == le) break;
+		n += snip-3;
+		le -= snip-3;
+	}
+	if (le > 0){
+		int i, l = le > 4 ? 4 : le;
+
+		if (ring_peek(rbuf, buf, l, n+le-l) < 0) return -1;
+		for(i=0; i < l; i++)
+			if (buf[i]==0)
+				return -2;
+	}
+	return -1;
+}
+
 int ring_find_any_header(ringbuffer *rbuf, uint8_t *head, int off, int le)
 {
 	uint8_t a=0;
@@ -394,3 +444,13 @@ int ring_find_any_header(ringbuffer *rbuf, uint8_t *head, int off, int le)
 	*head=a;
 	return x;
 }
+
+
+/* monotonic wall clock in microseconds */
+uint64_t time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+}
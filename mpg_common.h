@@ -51,6 +51,7 @@ typedef struct index_unit_s{
 	uint8_t  err;
 	int      framesize;
 	uint8_t  *fillframe;
+	uint64_t arrival;   // wall clock in us when read, for -L
 } index_unit;
 
 #define NO_ERR    0
@@ -67,5 +68,7 @@ uint64_t trans_pts_dts(uint8_t *pts);
 int mring_peek( ringbuffer *rbuf, uint8_t *buf, int l, long off);
 int ring_find_mpg_header(ringbuffer *rbuf, uint8_t head, int off, int le);
 int ring_find_any_header(ringbuffer *rbuf, uint8_t *head, int off, int le);
+int ring_find_nonslice_header(ringbuffer *rbuf, uint8_t *head, int off, int le);
+uint64_t time_us(void);
 
 #endif /*_MPG_COMMON_H_*/
@@ -0,0 +1,1034 @@
+/*
+ * mpggen.c: generate synthetic MPEG-2 TS, PS and AVI streams
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * The streams only have valid headers (sequence, GOP, picture, slice,
+ * MPEG audio and AC3 frame headers), the payload is pseudo random
+ * without zero bytes, so no start codes are emulated. The same options
+ * always give the same file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#define GEN_TS  0
+#define GEN_PS  1
+#define GEN_AVI 2
+
+#define N_TRACK 8
+#define N_PROG  4
+
+#define BASE_PTS   90000   /* first video DTS is about 1s */
+#define FRAME_TIME 3600    /* 25 fps in 90kHz */
+#define MPA_TIME   2160    /* 1152 samples at 48kHz */
+#define AC3_TIME   2880    /* 1536 samples at 48kHz */
+#define MPA_SIZE   576     /* layer II 192kbit/s */
+#define AC3_SIZE   1792    /* 448kbit/s */
+#define VIDEO_LEAD 27000   /* video is sent 300ms before its DTS */
+#define AUDIO_LEAD 18000   /* audio 200ms before its PTS */
+#define PSI_TIME   9000    /* PAT/PMT every 100ms */
+#define AVI_MAX    60000   /* replex reads AVI chunks up to 0xffff */
+
+#define PAT_PID    0x0000
+#define PMT_PID    0x0020
+#define VIDEO_PID  0x0100
+#define AUDIO_PID  0x0110
+#define AC3_PID    0x0180
+#define PROG_STEP  0x0400  /* PID offset of each further program */
+
+#define TS_SIZE    188
+#define M2TS_SIZE  192     /* 4 byte arrival timestamp in front */
+#define RS_SIZE    204     /* 16 bytes RS parity after the packet */
+#define PACK_SIZE  2048
+
+enum { U_VIDEO, U_AUDIO, U_AC3 };
+
+typedef struct unit_s {
+	int64_t t;		/* send time */
+	int64_t pts;
+	int64_t dts;
+	int type;
+	int prog;
+	int track;
+	int key;
+	int nframes;
+	int length;
+	uint8_t *data;
+} unit;
+
+typedef struct gen_s {
+	int otype;
+	int seconds;
+	int kbit;
+	int gop;
+	int bframes;
+	int naudio;
+	int nac3;
+	int jump_at;		/* in s, 0 = none */
+	int jump_ms;
+	int loss;		/* drop every n-th packet, 0 = none */
+	int packet;		/* TS packet size */
+	int programs;		/* TS programs, each with all tracks */
+	uint32_t seed;
+
+	unit *units;
+	int nunits;
+	int maxunits;
+
+	FILE *out;
+	uint64_t written;
+	int count;		/* packets seen for the loss counter */
+	int dropped;
+	uint8_t cc[0x2000];
+	int64_t last_psi;
+	int64_t now;		/* send time of the unit being written */
+	int jumped;
+} gen;
+
+typedef struct bitwriter_s {
+	uint8_t *buf;
+	int length;
+	int size;
+	int bits;
+	uint32_t acc;
+} bitwriter;
+
+static void bw_put(bitwriter *w, uint32_t val, int n)
+{
+	while (n--){
+		w->acc = (w->acc << 1) | ((val >> n) & 1);
+		if (++w->bits < 8) continue;
+		if (w->length == w->size){
+			w->size = 2*w->size + 4096;
+			w->buf = realloc(w->buf, w->size);
+			if (!w->buf){
+				fprintf(stderr,"Not enough memory\n");
+				exit(1);
+			}
+		}
+		w->buf[w->length++] = w->acc;
+		w->bits = 0;
+		w->acc = 0;
+	}
+}
+
+static void bw_startcode(bitwriter *w, uint8_t code)
+{
+	while (w->bits) bw_put(w, 0, 1);
+	bw_put(w, 0x000001, 24);
+	bw_put(w, code, 8);
+}
+
+static uint32_t rand_next(gen *g)
+{
+	g->seed = g->seed*1103515245 + 12345;
+	return (g->seed >> 16) & 0x7fff;
+}
+
+static uint8_t rand_byte(gen *g)
+{
+	return rand_next(g) % 255 + 1;
+}
+
+static unit *new_unit(gen *g)
+{
+	unit *u;
+
+	if (g->nunits == g->maxunits){
+		g->maxunits = 2*g->maxunits + 1024;
+		g->units = realloc(g->units, g->maxunits*sizeof(unit));
+		if (!g->units){
+			fprintf(stderr,"Not enough memory\n");
+			exit(1);
+		}
+	}
+	u = &g->units[g->nunits++];
+	memset(u, 0, sizeof(unit));
+	return u;
+}
+
+static void sequence_header(gen *g, bitwriter *w, int frame)
+{
+	int sec = frame/25;
+
+	bw_startcode(w, 0xB3);
+	bw_put(w, 720, 12);
+	bw_put(w, 576, 12);
+	bw_put(w, 2, 4);		/* 4:3 */
+	bw_put(w, 3, 4);		/* 25 fps */
+	bw_put(w, g->kbit*1000/400, 18);
+	bw_put(w, 1, 1);
+	bw_put(w, 112, 10);		/* vbv buffer 112*16kbit */
+	bw_put(w, 0, 3);
+
+	bw_startcode(w, 0xB5);		/* sequence extension */
+	bw_put(w, 1, 4);
+	bw_put(w, 0x48, 8);		/* main profile, main level */
+	bw_put(w, 0, 1);		/* interlaced */
+	bw_put(w, 1, 2);		/* 4:2:0 */
+	bw_put(w, 0, 4);
+	bw_put(w, 0, 12);
+	bw_put(w, 1, 1);
+	bw_put(w, 0, 8);
+	bw_put(w, 0, 1);
+	bw_put(w, 0, 7);
+
+	bw_startcode(w, 0xB8);		/* GOP */
+	bw_put(w, 0, 1);
+	bw_put(w, sec/3600, 5);
+	bw_put(w, (sec/60)%60, 6);
+	bw_put(w, 1, 1);
+	bw_put(w, sec%60, 6);
+	bw_put(w, frame%25, 6);
+	bw_put(w, frame == 0, 1);	/* closed GOP */
+	bw_put(w, 0, 1);
+}
+
+static void picture(gen *g, bitwriter *w, int tref, int ptype, int size)
+{
+	int s, n, slices = 36;
+
+	bw_startcode(w, 0x00);
+	bw_put(w, tref, 10);
+	bw_put(w, ptype, 3);
+	bw_put(w, 0xFFFF, 16);		/* vbv delay */
+	if (ptype >= 2) bw_put(w, 0x7, 4);
+	if (ptype == 3) bw_put(w, 0x7, 4);
+	bw_put(w, 0, 1);
+
+	bw_startcode(w, 0xB5);		/* picture coding extension */
+	bw_put(w, 8, 4);
+	bw_put(w, ptype >= 2 ? 1 : 15, 4);
+	bw_put(w, ptype >= 2 ? 1 : 15, 4);
+	bw_put(w, ptype == 3 ? 1 : 15, 4);
+	bw_put(w, ptype == 3 ? 1 : 15, 4);
+	bw_put(w, 0, 2);		/* intra dc precision */
+	bw_put(w, 3, 2);		/* frame picture */
+	bw_put(w, 1, 1);		/* top field first */
+	bw_put(w, 0, 5);
+	bw_put(w, 0, 1);		/* repeat first field */
+	bw_put(w, 1, 1);		/* 4:2:0 */
+	bw_put(w, 0, 2);
+
+	for (s = 1; s <= slices; s++){
+		bw_startcode(w, s);
+		for (n = 0; n < size/slices; n++)
+			bw_put(w, rand_byte(g), 8);
+	}
+}
+
+static void make_video(gen *g, int prog)
+{
+	int nframes = g->seconds*25;
+	int m = g->bframes + 1;
+	int anchors = g->gop/m;
+	int weight = 5 + 2*(anchors-1) + (g->gop-anchors);
+	int unitsize = (int)((int64_t)g->kbit*1000/8/25*g->gop/weight);
+	int i;
+
+	for (i = 0; i < nframes; i++){
+		int n = i % g->gop;
+		int gstart = i - n;
+		int k = n / m;
+		int b = n % m;
+		int tref, ptype, size;
+		bitwriter w;
+		unit *u;
+
+		if (!b){
+			tref = k*m + m-1;
+			ptype = k ? 2 : 1;
+		} else {
+			tref = k*m + b-1;
+			ptype = 3;
+		}
+		size = unitsize * (ptype == 1 ? 5 : ptype == 2 ? 2 : 1);
+		size += (int)(rand_next(g) % (size/5+1)) - size/10;
+		if (g->otype == GEN_AVI && size > AVI_MAX - 200)
+			size = AVI_MAX - 200;
+
+		memset(&w, 0, sizeof(w));
+		if (!n) sequence_header(g, &w, i);
+		picture(g, &w, tref, ptype, size);
+		while (w.bits) bw_put(&w, 0, 1);
+		if (w.length & 1) bw_put(&w, 0xFF, 8);
+
+		u = new_unit(g);
+		u->type = U_VIDEO;
+		u->prog = prog;
+		u->key = ptype == 1;
+		u->nframes = 1;
+		u->data = w.buf;
+		u->length = w.length;
+		u->pts = BASE_PTS + (int64_t)(gstart + tref)*FRAME_TIME;
+		u->dts = BASE_PTS + (int64_t)(i - (m > 1))*FRAME_TIME;
+		if (ptype == 3) u->dts = u->pts;
+		u->t = u->dts - VIDEO_LEAD;
+	}
+}
+
+static void make_audio(gen *g, int prog, int track, int ac3)
+{
+	int fsize = ac3 ? AC3_SIZE : MPA_SIZE;
+	int ftime = ac3 ? AC3_TIME : MPA_TIME;
+	int per, f, nf;
+
+	/* a PS audio PES has to fit into one pack */
+	switch (g->otype){
+	case GEN_TS:
+		per = ac3 ? 2 : 4;
+		break;
+	case GEN_PS:
+		per = ac3 ? 1 : 3;
+		break;
+	default:
+		per = 1;
+		break;
+	}
+
+	nf = (int)((int64_t)g->seconds*90000/ftime);
+	for (f = 0; f < nf; f += per){
+		int j, n = nf-f < per ? nf-f : per;
+		unit *u = new_unit(g);
+		uint8_t *p;
+
+		u->type = ac3 ? U_AC3 : U_AUDIO;
+		u->prog = prog;
+		u->track = track;
+		u->key = 1;
+		u->nframes = n;
+		u->length = n*fsize;
+		u->data = malloc(u->length);
+		if (!u->data){
+			fprintf(stderr,"Not enough memory\n");
+			exit(1);
+		}
+		u->pts = u->dts = BASE_PTS + (int64_t)f*ftime;
+		u->t = u->pts - AUDIO_LEAD;
+
+		for (j = 0; j < n; j++){
+			int q;
+			p = u->data + j*fsize;
+			for (q = 0; q < fsize; q++) p[q] = rand_next(g) % 127 + 1;
+			if (ac3){
+				p[0] = 0x0B;
+				p[1] = 0x77;
+				p[4] = 0x1E;	/* 48kHz, 448kbit/s */
+				p[5] = 0x40;	/* bsid 8 */
+			} else {
+				p[0] = 0xFF;
+				p[1] = 0xFD;	/* MPEG-1 layer II, no CRC */
+				p[2] = 0xA4;	/* 192kbit/s, 48kHz */
+				p[3] = 0x04;	/* stereo, original */
+			}
+		}
+	}
+}
+
+static int cmp_unit(const void *a, const void *b)
+{
+	const unit *ua = a;
+	const unit *ub = b;
+
+	if (ua->t != ub->t) return ua->t < ub->t ? -1 : 1;
+	if (ua->prog != ub->prog) return ua->prog - ub->prog;
+	if (ua->type != ub->type) return ua->type - ub->type;
+	return ua->track - ub->track;
+}
+
+/* everything sent after the jump position is shifted, like a cut */
+static int64_t jump(gen *g, unit *u)
+{
+	if (g->jump_at && u->t >= BASE_PTS + (int64_t)g->jump_at*90000)
+		return (int64_t)g->jump_ms*90;
+	return 0;
+}
+
+static int drop(gen *g)
+{
+	if (g->loss && !(++g->count % g->loss)){
+		g->dropped++;
+		return 1;
+	}
+	return 0;
+}
+
+static void out(gen *g, uint8_t *buf, int length)
+{
+	if (fwrite(buf, 1, length, g->out) != (size_t)length){
+		perror("Error writing output");
+		exit(1);
+	}
+	g->written += length;
+}
+
+static void put32(uint8_t *b, uint32_t v)
+{
+	b[0] = v;
+	b[1] = v >> 8;
+	b[2] = v >> 16;
+	b[3] = v >> 24;
+}
+
+static void put_ts(uint8_t *b, int marker, int64_t ts)
+{
+	b[0] = marker | ((ts >> 29) & 0x0E) | 1;
+	b[1] = ts >> 22;
+	b[2] = ((ts >> 14) & 0xFE) | 1;
+	b[3] = ts >> 7;
+	b[4] = ((ts << 1) & 0xFE) | 1;
+}
+
+static uint8_t stream_id(gen *g, unit *u)
+{
+	switch (u->type){
+	case U_VIDEO:
+		return 0xE0;
+	case U_AUDIO:
+		return 0xC0 + u->track;
+	default:
+		return 0xBD;
+	}
+}
+
+static int pes_header(gen *g, unit *u, uint8_t *b, int first, int length)
+{
+	int64_t off = jump(g, u);
+	int c = 9;
+
+	b[0] = 0x00;
+	b[1] = 0x00;
+	b[2] = 0x01;
+	b[3] = stream_id(g, u);
+	b[6] = 0x80;
+	b[7] = 0x00;
+	if (first){
+		if (u->dts != u->pts){
+			b[7] = 0xC0;
+			put_ts(b+c, 0x30, u->pts + off);
+			put_ts(b+c+5, 0x10, u->dts + off);
+			c += 10;
+		} else {
+			b[7] = 0x80;
+			put_ts(b+c, 0x20, u->pts + off);
+			c += 5;
+		}
+	}
+	b[8] = c - 9;
+	if (first && u->type == U_AC3 && g->otype == GEN_PS){
+		b[c++] = 0x80 + u->track;
+		b[c++] = u->nframes;
+		b[c++] = 0x00;
+		b[c++] = 0x01;
+	}
+	length += c - 6;
+	if (length > 0xFFFF) length = 0;
+	b[4] = length >> 8;
+	b[5] = length;
+	return c;
+}
+
+static uint32_t crc32_mpeg(uint8_t *d, int length)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	int i, j;
+
+	for (i = 0; i < length; i++){
+		crc ^= (uint32_t)d[i] << 24;
+		for (j = 0; j < 8; j++)
+			crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+	}
+	return crc;
+}
+
+/* M2TS packets get the send time as 27MHz arrival timestamp, RS packets
+   the CRC of the packet in place of the parity */
+static void ts_out(gen *g, uint8_t *ts)
+{
+	uint8_t extra[16];
+	uint32_t v;
+	int i;
+
+	if (drop(g)) return;
+	if (g->packet == M2TS_SIZE){
+		v = (g->now * 300) & 0x3FFFFFFF;
+		extra[0] = v >> 24;
+		extra[1] = v >> 16;
+		extra[2] = v >> 8;
+		extra[3] = v;
+		out(g, extra, 4);
+	}
+	out(g, ts, TS_SIZE);
+	if (g->packet == RS_SIZE){
+		v = crc32_mpeg(ts, TS_SIZE);
+		for (i = 0; i < 16; i++)
+			extra[i] = v >> (8*(i&3));
+		out(g, extra, 16);
+	}
+}
+
+static void ts_section(gen *g, int pid, uint8_t *sec, int length)
+{
+	uint8_t ts[TS_SIZE];
+	uint32_t crc;
+
+	sec[1] = 0xB0 | ((length+1) >> 8);
+	sec[2] = length+1;
+	crc = crc32_mpeg(sec, length-3);
+	sec[length-3] = crc >> 24;
+	sec[length-2] = crc >> 16;
+	sec[length-1] = crc >> 8;
+	sec[length] = crc;
+
+	memset(ts, 0xFF, TS_SIZE);
+	ts[0] = 0x47;
+	ts[1] = 0x40 | (pid >> 8);
+	ts[2] = pid;
+	ts[3] = 0x10 | (g->cc[pid]++ & 0x0F);
+	ts[4] = 0x00;
+	memcpy(ts+5, sec, length+1);
+	ts_out(g, ts);
+}
+
+static void ts_psi(gen *g)
+{
+	uint8_t sec[TS_SIZE];
+	int c, i, k;
+
+	memset(sec, 0, sizeof(sec));
+	sec[0] = 0x00;
+	sec[3] = 0x00;
+	sec[4] = 0x01;		/* transport stream id */
+	sec[5] = 0xC1;
+	c = 8;
+	for (k = 0; k < g->programs; k++){
+		sec[c++] = 0x00;
+		sec[c++] = k+1;		/* program k+1 */
+		sec[c++] = 0xE0 | ((PMT_PID+k) >> 8);
+		sec[c++] = (PMT_PID+k) & 0xFF;
+	}
+	ts_section(g, PAT_PID, sec, c+3);
+
+	for (k = 0; k < g->programs; k++){
+		int v = VIDEO_PID + k*PROG_STEP;
+		int a = AUDIO_PID + k*PROG_STEP;
+		int a3 = AC3_PID + k*PROG_STEP;
+
+		memset(sec, 0, sizeof(sec));
+		sec[0] = 0x02;
+		sec[3] = 0x00;
+		sec[4] = k+1;
+		sec[5] = 0xC1;
+		sec[8] = 0xE0 | (v >> 8);
+		sec[9] = v & 0xFF;
+		sec[10] = 0xF0;
+		c = 12;
+		sec[c++] = 0x02;
+		sec[c++] = 0xE0 | (v >> 8);
+		sec[c++] = v & 0xFF;
+		sec[c++] = 0xF0;
+		sec[c++] = 0x00;
+		for (i = 0; i < g->naudio; i++){
+			sec[c++] = 0x04;
+			sec[c++] = 0xE0 | ((a+i) >> 8);
+			sec[c++] = (a+i) & 0xFF;
+			sec[c++] = 0xF0;
+			sec[c++] = 0x00;
+		}
+		for (i = 0; i < g->nac3; i++){
+			sec[c++] = 0x06;
+			sec[c++] = 0xE0 | ((a3+i) >> 8);
+			sec[c++] = (a3+i) & 0xFF;
+			sec[c++] = 0xF0;
+			sec[c++] = 0x02;
+			sec[c++] = 0x6A;	/* AC3 descriptor */
+			sec[c++] = 0x00;
+		}
+		ts_section(g, PMT_PID+k, sec, c+3);
+	}
+}
+
+static void write_ts_unit(gen *g, unit *u)
+{
+	uint8_t head[32];
+	int pid, hl, pos = 0;
+	int first = 1;
+
+	g->now = u->t;
+	if (g->last_psi < 0 || u->t - g->last_psi >= PSI_TIME){
+		ts_psi(g);
+		g->last_psi = u->t;
+	}
+
+	switch (u->type){
+	case U_VIDEO:
+		pid = VIDEO_PID;
+		break;
+	case U_AUDIO:
+		pid = AUDIO_PID + u->track;
+		break;
+	default:
+		pid = AC3_PID + u->track;
+		break;
+	}
+	pid += u->prog*PROG_STEP;
+	hl = pes_header(g, u, head, 1, u->length);
+
+	while (pos < hl + u->length){
+		uint8_t ts[TS_SIZE];
+		int c = 4, room, left = hl + u->length - pos;
+		int n;
+
+		memset(ts, 0xFF, TS_SIZE);
+		ts[0] = 0x47;
+		ts[1] = (first ? 0x40 : 0) | (pid >> 8);
+		ts[2] = pid;
+		if (first && u->type == U_VIDEO){
+			int64_t pcr = u->t - VIDEO_LEAD/3 + jump(g, u);
+
+			ts[4] = 7;
+			ts[5] = 0x10;
+			if (jump(g, u) && !g->jumped){
+				ts[5] |= 0x80;	/* discontinuity */
+				g->jumped = 1;
+			}
+			ts[6] = pcr >> 25;
+			ts[7] = pcr >> 17;
+			ts[8] = pcr >> 9;
+			ts[9] = pcr >> 1;
+			ts[10] = ((pcr & 1) << 7) | 0x7E;
+			ts[11] = 0;
+			c = 12;
+		}
+		room = TS_SIZE - c;
+		if (left < room){
+			int stuff = room - left;
+			if (c == 4){
+				ts[4] = stuff - 1;
+				if (stuff > 1) ts[5] = 0x00;
+				c += stuff;
+			} else {
+				ts[4] += stuff;
+				c += stuff;
+			}
+		}
+		ts[3] = (c > 4 ? 0x30 : 0x10) | (g->cc[pid]++ & 0x0F);
+
+		n = TS_SIZE - c;
+		while (n){
+			int l;
+			if (pos < hl){
+				l = hl - pos < n ? hl - pos : n;
+				memcpy(ts + TS_SIZE - n, head + pos, l);
+			} else {
+				l = n;
+				memcpy(ts + TS_SIZE - n, u->data + pos - hl, l);
+			}
+			pos += l;
+			n -= l;
+		}
+		first = 0;
+		ts_out(g, ts);
+	}
+}
+
+static void write_ps_unit(gen *g, unit *u)
+{
+	int pos = 0;
+	int first = 1;
+
+	while (pos < u->length){
+		uint8_t pack[PACK_SIZE];
+		int64_t scr = u->t - VIDEO_LEAD/3 + jump(g, u);
+		int c = 0, hl, n, stuff;
+
+		pack[c++] = 0x00;
+		pack[c++] = 0x00;
+		pack[c++] = 0x01;
+		pack[c++] = 0xBA;
+		pack[c++] = 0x44 | ((scr >> 27) & 0x38) | ((scr >> 28) & 0x03);
+		pack[c++] = scr >> 20;
+		pack[c++] = 0x04 | ((scr >> 12) & 0xF8) | ((scr >> 13) & 0x03);
+		pack[c++] = scr >> 5;
+		pack[c++] = 0x04 | ((scr << 3) & 0xF8);
+		pack[c++] = 0x01;
+		pack[c++] = 0x01;	/* mux rate 10.08 Mbit/s */
+		pack[c++] = 0x89;
+		pack[c++] = 0xC3;
+		pack[c++] = 0xF8;
+
+		hl = pes_header(g, u, pack+c, first, 0);
+		n = u->length - pos;
+		if (n > PACK_SIZE - c - hl) n = PACK_SIZE - c - hl;
+		pes_header(g, u, pack+c, first, n);
+		c += hl;
+		memcpy(pack+c, u->data+pos, n);
+		c += n;
+		pos += n;
+		first = 0;
+
+		/* fill the pack with a padding packet */
+		stuff = PACK_SIZE - c;
+		if (stuff >= 6){
+			pack[c++] = 0x00;
+			pack[c++] = 0x00;
+			pack[c++] = 0x01;
+			pack[c++] = 0xBE;
+			pack[c++] = (stuff-6) >> 8;
+			pack[c++] = (stuff-6);
+			memset(pack+c, 0xFF, stuff-6);
+			c += stuff-6;
+		}
+		if (!drop(g)) out(g, pack, c);
+	}
+}
+
+static uint32_t avi_chunk_id(unit *u)
+{
+	if (u->type == U_VIDEO) return 0x63643030;	/* 00dc */
+	return 0x62773130;				/* 01wb */
+}
+
+static void write_avi(gen *g)
+{
+	uint8_t h[512];
+	uint8_t *idx;
+	uint32_t movi_size = 4, nidx = 0;
+	int i, c = 0, vframes = 0, aframes = 0;
+
+	/* AVI only has room for the first MPEG audio track */
+	for (i = 0; i < g->nunits; i++){
+		unit *u = &g->units[i];
+		if (u->type == U_VIDEO) vframes++;
+		else if (u->type == U_AUDIO && !u->track) aframes++;
+	}
+	idx = malloc(16*(vframes + aframes));
+	if (!idx){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < g->nunits; i++){
+		unit *u = &g->units[i];
+		if (u->type != U_VIDEO && (u->type != U_AUDIO || u->track))
+			continue;
+		if (drop(g)){
+			u->length = -1;
+			continue;
+		}
+		put32(idx+16*nidx, avi_chunk_id(u));
+		put32(idx+16*nidx+4, u->key ? 0x10 : 0);
+		put32(idx+16*nidx+8, movi_size);
+		put32(idx+16*nidx+12, u->length);
+		nidx++;
+		movi_size += 8 + u->length;
+	}
+
+	memset(h, 0, sizeof(h));
+	memcpy(h+c, "RIFF", 4);
+	c += 8;
+	memcpy(h+c, "AVI ", 4);
+	c += 4;
+
+	memcpy(h+c, "LIST", 4);
+	put32(h+c+4, 4 + 64 + 2*(12 + 64) + 48 + 38);
+	memcpy(h+c+8, "hdrl", 4);
+	c += 12;
+
+	memcpy(h+c, "avih", 4);
+	put32(h+c+4, 56);
+	put32(h+c+8, 1000000/25);
+	put32(h+c+12, g->kbit*1000/8);
+	put32(h+c+20, 0x10);		/* AVI_HASINDEX */
+	put32(h+c+24, vframes);
+	put32(h+c+32, 2);
+	put32(h+c+36, AVI_MAX);
+	put32(h+c+40, 720);
+	put32(h+c+44, 576);
+	c += 64;
+
+	memcpy(h+c, "LIST", 4);
+	put32(h+c+4, 4 + 64 + 48);
+	memcpy(h+c+8, "strl", 4);
+	c += 12;
+	memcpy(h+c, "strh", 4);
+	put32(h+c+4, 56);
+	memcpy(h+c+8, "vids", 4);
+	memcpy(h+c+12, "mpg2", 4);
+	put32(h+c+28, 1);		/* scale */
+	put32(h+c+32, 25);		/* rate */
+	put32(h+c+40, vframes);
+	put32(h+c+44, AVI_MAX);
+	c += 64;
+	memcpy(h+c, "strf", 4);
+	put32(h+c+4, 40);
+	put32(h+c+8, 40);
+	put32(h+c+12, 720);
+	put32(h+c+16, 576);
+	h[c+20] = 1;
+	h[c+22] = 24;
+	memcpy(h+c+24, "mpg2", 4);
+	c += 48;
+
+	memcpy(h+c, "LIST", 4);
+	put32(h+c+4, 4 + 64 + 38);
+	memcpy(h+c+8, "strl", 4);
+	c += 12;
+	memcpy(h+c, "strh", 4);
+	put32(h+c+4, 56);
+	memcpy(h+c+8, "auds", 4);
+	put32(h+c+28, MPA_TIME*48000/90000);	/* scale, samples per frame */
+	put32(h+c+32, 48000);
+	put32(h+c+40, aframes);
+	put32(h+c+44, MPA_SIZE);
+	c += 64;
+	memcpy(h+c, "strf", 4);
+	put32(h+c+4, 30);
+	h[c+8] = 0x50;			/* WAVE_FORMAT_MPEG */
+	h[c+10] = 2;
+	put32(h+c+12, 48000);
+	put32(h+c+16, 192000/8);
+	h[c+20] = 1;
+	c += 38;
+
+	memcpy(h+c, "LIST", 4);
+	put32(h+c+4, movi_size);
+	memcpy(h+c+8, "movi", 4);
+	c += 12;
+
+	put32(h+4, c - 8 + movi_size - 4 + 8 + 16*nidx);
+	out(g, h, c);
+
+	for (i = 0; i < g->nunits; i++){
+		unit *u = &g->units[i];
+		uint8_t ch[8];
+
+		if (u->type != U_VIDEO && (u->type != U_AUDIO || u->track))
+			continue;
+		if (u->length < 0) continue;
+		put32(ch, avi_chunk_id(u));
+		put32(ch+4, u->length);
+		out(g, ch, 8);
+		out(g, u->data, u->length);
+	}
+
+	memcpy(h, "idx1", 4);
+	put32(h+4, 16*nidx);
+	out(g, h, 8);
+	out(g, idx, 16*nidx);
+	free(idx);
+}
+
+void usage(char *progname)
+{
+        printf ("usage: %s [options]\n\n",progname);
+        printf ("options:\n");
+        printf ("  --help,             -h            :  print help message\n");
+        printf ("\n");
+        printf ("  --audio,            -a <integer>  :  number of MPEG audio tracks (default 1)\n");
+        printf ("  --bitrate,          -b <integer>  :  video bitrate in kbit/s (default 6000)\n");
+        printf ("  --ac3,              -c <integer>  :  number of AC3 tracks (default 1)\n");
+        printf ("  --gop,              -g <integer>  :  GOP length in frames (default 12)\n");
+        printf ("  --jump,             -j <integer>  :  PTS jump after <int> seconds\n");
+        printf ("  --jump_size,        -J <integer>  :  size of the PTS jump in ms (default 5000)\n");
+        printf ("  --loss,             -l <integer>  :  drop every <int>th TS packet, PS pack or AVI chunk\n");
+        printf ("  --bframes,          -m <integer>  :  B frames between anchor frames (default 2)\n");
+        printf ("  --length,           -n <integer>  :  length in seconds (default 30)\n");
+        printf ("  --of,               -o <filename> :  set output file (default stdout)\n");
+        printf ("  --programs,         -P <integer>  :  number of TS programs, PIDs 0x400 apart (default 1)\n");
+        printf ("  --seed,             -s <integer>  :  seed for the payload (default 1)\n");
+        printf ("  --packet_size,      -S <integer>  :  TS packet size 188 (default), 192 (M2TS) or 204 (RS)\n");
+        printf ("  --type,             -t <string>   :  set output type (string = TS(default), PS, AVI)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	gen g;
+	char *filename = NULL;
+	char *type = "TS";
+	int c, i, k;
+
+	memset(&g, 0, sizeof(gen));
+	g.seconds = 30;
+	g.kbit = 6000;
+	g.gop = 12;
+	g.bframes = 2;
+	g.naudio = 1;
+	g.nac3 = 1;
+	g.jump_ms = 5000;
+	g.seed = 1;
+	g.last_psi = -1;
+	g.packet = TS_SIZE;
+	g.programs = 1;
+
+        while (1){
+                int option_index = 0;
+                static struct option long_options[] = {
+			{"audio", required_argument, NULL, 'a'},
+			{"bitrate", required_argument, NULL, 'b'},
+			{"ac3", required_argument, NULL, 'c'},
+			{"gop", required_argument, NULL, 'g'},
+			{"help", no_argument , NULL, 'h'},
+			{"jump", required_argument, NULL, 'j'},
+			{"jump_size", required_argument, NULL, 'J'},
+			{"loss", required_argument, NULL, 'l'},
+			{"bframes", required_argument, NULL, 'm'},
+			{"length", required_argument, NULL, 'n'},
+			{"of", required_argument, NULL, 'o'},
+			{"programs", required_argument, NULL, 'P'},
+			{"seed", required_argument, NULL, 's'},
+			{"packet_size", required_argument, NULL, 'S'},
+			{"type", required_argument, NULL, 't'},
+			{0, 0, 0, 0}
+		};
+                c = getopt_long (argc, argv,
+				 "a:b:c:g:hj:J:l:m:n:o:P:s:S:t:",
+                                 long_options, &option_index);
+                if (c == -1)
+                        break;
+
+                switch (c){
+                case 'a':
+			g.naudio = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'b':
+			g.kbit = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'c':
+			g.nac3 = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'g':
+			g.gop = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'j':
+			g.jump_at = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'J':
+			g.jump_ms = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'l':
+			g.loss = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'm':
+			g.bframes = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'n':
+			g.seconds = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'o':
+			filename = optarg;
+			break;
+                case 'P':
+			g.programs = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 's':
+			g.seed = strtoul(optarg,(char **)NULL, 0);
+			break;
+                case 'S':
+			g.packet = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 't':
+			type = optarg;
+			break;
+                case 'h':
+                case '?':
+                default:
+                        usage(argv[0]);
+                }
+        }
+
+	if (!strncmp(type,"TS",3)){
+		g.otype = GEN_TS;
+	} else if (!strncmp(type,"PS",3)){
+		g.otype = GEN_PS;
+	} else if (!strncmp(type,"AVI",4)){
+		g.otype = GEN_AVI;
+	} else {
+		usage(argv[0]);
+	}
+
+	if (g.naudio < 0 || g.naudio > N_TRACK || g.nac3 < 0 ||
+	    g.nac3 > N_TRACK || g.seconds <= 0 || g.kbit <= 0 ||
+	    g.bframes < 0 || g.gop <= 0 || g.gop % (g.bframes+1) ||
+	    g.gop > 1023 || g.loss < 0 || (g.packet != TS_SIZE &&
+	    g.packet != M2TS_SIZE && g.packet != RS_SIZE) ||
+	    g.programs < 1 || g.programs > N_PROG ||
+	    (g.programs > 1 && g.otype != GEN_TS)){
+		fprintf(stderr,"Invalid stream parameters\n");
+		exit(1);
+	}
+
+	if (filename){
+		if (!(g.out = fopen(filename, "w"))){
+			perror("Error opening output file");
+			exit(1);
+		}
+	} else g.out = stdout;
+
+	for (k = 0; k < g.programs; k++){
+		make_video(&g, k);
+		for (i = 0; i < g.naudio; i++)
+			make_audio(&g, k, i, 0);
+		for (i = 0; i < g.nac3; i++)
+			make_audio(&g, k, i, 1);
+	}
+	qsort(g.units, g.nunits, sizeof(unit), cmp_unit);
+
+	switch (g.otype){
+	case GEN_TS:
+		for (i = 0; i < g.nunits; i++)
+			write_ts_unit(&g, &g.units[i]);
+		break;
+	case GEN_PS:
+		for (i = 0; i < g.nunits; i++)
+			write_ps_unit(&g, &g.units[i]);
+		{
+			uint8_t end[4] = { 0x00, 0x00, 0x01, 0xB9 };
+			out(&g, end, 4);
+		}
+		break;
+	case GEN_AVI:
+		write_avi(&g);
+		break;
+	}
+
+	if (fclose(g.out)){
+		perror("Error writing output");
+		exit(1);
+	}
+	for (i = 0; i < g.nunits; i++)
+		free(g.units[i].data);
+	free(g.units);
+
+	fprintf(stderr,"%s: %d s, %llu bytes", type, g.seconds,
+		(unsigned long long)g.written);
+	if (g.dropped) fprintf(stderr,", %d dropped", g.dropped);
+	fprintf(stderr,"\n");
+	return 0;
+}
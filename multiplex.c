@@ -31,11 +31,13 @@
 #include <stdlib.h>
 
 #include "multiplex.h"
+#include "stats.h"
 
 
 static int mplx_write(multiplex_t *mx, uint8_t *buffer,int length)
 {
 	int k=0;
+	int st;
 
 	if ( mx->max_write && mx->total_written+ length >  
 	     mx-> max_write && !mx->max_reached){
@@ -43,11 +45,38 @@ static int mplx_write(multiplex_t *mx, uint8_t *buffer,int length)
 		fprintf(stderr,"Maximum file size %dKB reached\n", mx->max_write/1024);
 		return 0;
 	}
+	st = stats_enter(ST_WRITE);
 	if ((k=write(mx->fd_out, buffer, length)) <= 0){
 		mx->zero_write_count++;
 	} else {
 		mx->total_written += k;
+		stats_add(ST_WRITE, k, 1);
 	}
+	stats_leave(st);
+	return k;
+}
+
+static int mplx_writev(multiplex_t *mx, struct iovec *iov, int iovcnt)
+{
+	int i, k=0;
+	int length=0;
+	int st;
+
+	for (i=0; i < iovcnt; i++) length += iov[i].iov_len;
+	if ( mx->max_write && mx->total_written+ length >  
+	     mx-> max_write && !mx->max_reached){
+		mx->max_reached = 1;
+		fprintf(stderr,"Maximum file size %dKB reached\n", mx->max_write/1024);
+		return 0;
+	}
+	st = stats_enter(ST_WRITE);
+	if ((k=writev(mx->fd_out, iov, iovcnt)) <= 0){
+		mx->zero_write_count++;
+	} else {
+		mx->total_written += k;
+		stats_add(ST_WRITE, k, 1);
+	}
+	stats_leave(st);
 	return k;
 }
 
@@ -58,43 +87,76 @@ static int buffers_filled(multiplex_t *mx)
 	vavail = ring_avail(mx->index_vrbuffer)/sizeof(index_unit);
 	
 	for (i=0; i<mx->apidn;i++){
-		aavail += ring_avail(&mx->index_arbuffer[i])/sizeof(index_unit);
+		aavail += ring_avail(&mx->astream[i].index_rbuffer)
+			/sizeof(index_unit);
 	}
 
 	for (i=0; i<mx->ac3n;i++){
-		aavail += ring_avail(&mx->index_ac3rbuffer[i])
+		aavail += ring_avail(&mx->ac3stream[i].index_rbuffer)
 			/sizeof(index_unit);
 	}
 	if (aavail+vavail) return ((aavail+vavail));
 	return 0;
 }
 
-static int all_audio_ok(int *aok, int n)
+/* min-heaps of audio streams, by time and on a tie AC3 before MPEG
+   audio and lower stream numbers first */
+static int sched_before(sched_entry *a, sched_entry *b)
 {
-	int ok=0,i;
+	int c;
 
-	if (!n) return 0;
-	for (i=0;  i < n ;i++){
-		if (aok[i]) ok ++;
-	}
-	if (ok == n) return 1;
-	return 0;
+	if ((c = ptscmp(a->time, b->time))) return c < 0;
+	if (a->type != b->type) return a->type == AC3;
+	return a->n < b->n;
 }
 
-static int rest_audio_ok(int j, int *aok, int n)
+static void sched_push(sched_heap *h, sched_entry *e)
 {
-	int ok=0,i;
+	int i = h->n++;
 
-	if (!(n-1)) return 0;
-	for (i=0;  i < n ;i++){
-		if (i!=j && aok[i]) ok ++;
+	while (i){
+		int up = (i-1)/2;
+		if (!sched_before(e, &h->e[up])) break;
+		h->e[i] = h->e[up];
+		i = up;
 	}
-	if (ok == n) return 1;
-	return 0;
+	h->e[i] = *e;
+}
+
+static int sched_pop(sched_heap *h, sched_entry *top)
+{
+	sched_entry last;
+	int i = 0;
+
+	if (!h->n) return 0;
+	*top = h->e[0];
+	last = h->e[--h->n];
+	while (2*i+1 < h->n){
+		int c = 2*i+1;
+		if (c+1 < h->n && sched_before(&h->e[c+1], &h->e[c])) c++;
+		if (!sched_before(&h->e[c], &last)) break;
+		h->e[i] = h->e[c];
+		i = c;
+	}
+	h->e[i] = last;
+	return 1;
+}
+
+/* the unit iu has been written, account for the time it waited */
+static void unit_latency(multiplex_t *mx, index_unit *iu)
+{
+	uint64_t lat;
+
+	if (!iu->arrival) return;
+	lat = time_us() - iu->arrival;
+	mx->lat_sum += lat;
+	if (lat > mx->lat_max) mx->lat_max = lat;
+	mx->lat_n++;
 }
 
 static int get_next_video_unit(multiplex_t *mx, index_unit *viu)
 {
+	if (mx->low_latency) unit_latency(mx, viu);
 	if (!ring_avail(mx->index_vrbuffer) && mx->finish) return 0;
 
 	while (ring_avail(mx->index_vrbuffer) < sizeof(index_unit))
@@ -133,42 +195,37 @@ static int peek_next_video_unit(multiplex_t *mx, index_unit *viu)
 	return 1;
 }
 	
-static int get_next_audio_unit(multiplex_t *mx, index_unit *aiu, int i)
+static int get_next_audio_unit(multiplex_t *mx, audio_stream_t *as)
 {
-	if (!ring_avail(&mx->index_arbuffer[i]) && mx->finish) return 0;
+	index_unit *aiu = &as->iu;
+
+	if (mx->low_latency) unit_latency(mx, aiu);
+	if (!ring_avail(&as->index_rbuffer) && mx->finish) return 0;
 
-	while(ring_avail(&mx->index_arbuffer[i]) < sizeof(index_unit))
+	while(ring_avail(&as->index_rbuffer) < sizeof(index_unit))
 		if (mx->fill_buffers(mx->priv, mx->finish)< 0) {
-			fprintf(stderr,"error in get next audio unit\n");
+			if (as->type == AC3)
+				fprintf(stderr,"error in get next ac3 unit\n");
+			else
+				fprintf(stderr,"error in get next audio unit\n");
 			return 0;
 		}
 	
-	ring_read(&mx->index_arbuffer[i], (uint8_t *)aiu, sizeof(index_unit));
+	ring_read(&as->index_rbuffer, (uint8_t *)aiu, sizeof(index_unit));
 
 #ifdef OUT_DEBUG
 	fprintf(stderr,"audio index start: %d  stop: %d  (%d)  rpos: %d\n", 
 		aiu->start, (aiu->start+aiu->length),
-		aiu->length, ring_rpos(&mx->arbuffer[i]));
+		aiu->length, ring_rpos(&as->rbuffer));
 #endif
 	return 1;
 }
 
-static int get_next_ac3_unit(multiplex_t *mx, index_unit *aiu, int i)
-{
-	if (!ring_avail(&mx->index_ac3rbuffer[i]) && mx->finish) return 0;
-	while(ring_avail(&mx->index_ac3rbuffer[i]) < sizeof(index_unit))
-		if (mx->fill_buffers(mx->priv, mx->finish)< 0) {
-			fprintf(stderr,"error in get next ac3 unit\n");
-			return 0;
-		}
-	
-	ring_read(&mx->index_ac3rbuffer[i], (uint8_t *)aiu, sizeof(index_unit));
-	return 1;
-}
-
 static void writeout_video(multiplex_t *mx)
 {  
 	uint8_t outbuf[3000];
+	struct iovec iov[PACK_IOV];
+	int iovcnt=0;
 	int written=0;
 	uint8_t ptsdts=0;
 	int length;
@@ -253,17 +310,31 @@ static void writeout_video(multiplex_t *mx)
 				   viu->pts+mx->video_delay, 
 				   viu->dts+mx->video_delay, 
 				   mx->SCR, mx->muxr, outbuf, &nlength, ptsdts,
-				   mx->vrbuffer);
+				   mx->vrbuffer, iov, &iovcnt);
+	if (written < 0){
+		mx->zero_write_count++;
+		return;
+	}
 
 	length -= nlength;
 	dummy_add(&mx->vdbuf, uptsdiff( viu->dts+mx->video_delay,0)
 		  , viu->length-length);
 	viu->length = length;
-	if (viu->gop){
-		pts2time( viu->pts + mx->video_delay, outbuf, written);
-	}
-
-	mplx_write(mx, outbuf, written);
+	if (!written){
+		mx->zero_write_count++;
+	} else if (viu->gop){
+		/* the GOP timecode is patched, so this pack gets copied */
+		uint8_t gopbuf[3000];
+		int i, pos=0;
+
+		for (i=0; i < iovcnt; i++){
+			memcpy(gopbuf+pos, iov[i].iov_base, iov[i].iov_len);
+			pos += iov[i].iov_len;
+		}
+		pts2time( viu->pts + mx->video_delay, gopbuf, written);
+		mplx_write(mx, gopbuf, written);
+	} else mplx_writev(mx, iov, iovcnt);
+	if (nlength > 0) ring_skip(mx->vrbuffer, nlength);
 	
 	if (viu->length == 0){
 		get_next_video_unit(mx, viu);
@@ -273,82 +344,63 @@ static void writeout_video(multiplex_t *mx)
 
 
 #define INSIZE 6000
-int add_to_inbuf(uint8_t *inbuf,ringbuffer *arbuffer, int inbc, int off, int length)
+#define AUDIO_IOV 256
+static int add_to_inbuf(struct iovec *inbuf, int *ninbuf, ringbuffer *arbuffer,
+			int inbc, int off, int length)
 {  
 	int add;
 	
-	if (inbc + length > INSIZE) {
+	if (inbc + length > INSIZE || *ninbuf + 2 > AUDIO_IOV) {
 		fprintf(stderr,"buffer too small in write_out_audio %d %d\n",inbc,length);
 		return 0;
 	}
-	add= ring_peek( arbuffer, inbuf+inbc, length, off);
-	if (add < length) {
+	add= ring_peek_iov( arbuffer, inbuf+*ninbuf, length, off);
+	if (add < 0) {
 		fprintf(stderr,"error while peeking audio ring %d (%d)\n", add,length);
 		return 0;
 	}
-	return add;
+	*ninbuf += add;
+	return length;
 }
 
 
-static void clear_audio(multiplex_t *mx, int type, int n)
+static void clear_audio(multiplex_t *mx, audio_stream_t *as)
 {
-	index_unit *aiu;
-	int g=0;
-	ringbuffer *arbuffer;
-
-	switch (type){
-		
-	case MPEG_AUDIO:
-#ifdef OUT_DEBUG
-		fprintf(stderr,"clear AUDIO%d pack\n",n);
-#endif
-		arbuffer = &mx->arbuffer[n];
-		aiu = &mx->aiu[n];
-		break;
+	index_unit *aiu = &as->iu;
 
-	case AC3:
 #ifdef OUT_DEBUG
-		fprintf(stderr,"clear AC3%d pack\n",n);
+	fprintf(stderr,"clear %s pack\n", as->type == AC3 ? "AC3":"AUDIO");
 #endif
-		arbuffer = &mx->ac3rbuffer[n];
-		aiu = &mx->ac3iu[n];
-		break;
-
-	default:
-		return;
-	}
 	while (aiu->err == JUMP_ERR){
 //		fprintf(stderr,"FOUND ONE\n");
-		ring_skip(arbuffer, aiu->length);		
-		if (type == MPEG_AUDIO)
-			g = get_next_audio_unit(mx, aiu, n);
-		else
-			g = get_next_ac3_unit(mx, aiu, n);		
+		ring_skip(&as->rbuffer, aiu->length);		
+		get_next_audio_unit(mx, as);
 	}
 
 }
 
 
 
-static void my_memcpy(uint8_t *target, int offset, uint8_t *source, int length, int maxlength)
+static void add_fillframe(struct iovec *inbuf, int *ninbuf, int offset, 
+			  uint8_t *source, int length, int maxlength)
 {
-	uint8_t *targ = NULL;
-
-	targ = target + offset;
-	
-	if ( offset+length > maxlength){
-		fprintf(stderr,"WARNING: buffer overflow in my_memcopy \n");
-//		fprintf(stderr, "source 0x%x  offset %d target 0x%x  length %d maxlength %d\n"
-//			, source, offset, target, length, maxlength);
+	if ( offset+length > maxlength || *ninbuf >= AUDIO_IOV){
+		fprintf(stderr,"WARNING: buffer overflow in add_fillframe \n");
+		if (*ninbuf >= AUDIO_IOV) return;
 	}
-	memcpy(targ, source, length);
+	inbuf[*ninbuf].iov_base = source;
+	inbuf[*ninbuf].iov_len = length;
+	(*ninbuf)++;
 }
 
 
 static void writeout_audio(multiplex_t *mx, int type, int n)
 {  
 	uint8_t outbuf[3000];
-	uint8_t inbuf[INSIZE];
+	struct iovec inbuf[AUDIO_IOV];
+	struct iovec iov[AUDIO_IOV+2];
+	int ninbuf=0;
+	int iovcnt=0;
 	int inbc=0;
 	int written=0;
 	int length=0;
@@ -365,7 +417,7 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 	int rest_data = 5;
 	uint64_t *apts;
 	index_unit *aiu;
-	int g=0;
+	audio_stream_t *as;
 	int add, off=0;
 	int fakelength = 0;
 	int droplength = 0;
@@ -376,32 +428,27 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 #ifdef OUT_DEBUG
 		fprintf(stderr,"writing AUDIO%d pack\n",n);
 #endif
-		airbuffer = &mx->index_arbuffer[n];
-		arbuffer = &mx->arbuffer[n];
-		dbuf = &mx->adbuf[n];
-		adelay = mx->apts_off[n];
-		aframesize = mx->aframes[n];	
-		apts = &mx->apts[n];
-		aiu = &mx->aiu[n];
+		as = &mx->astream[n];
 		break;
 
 	case AC3:
 #ifdef OUT_DEBUG
 		fprintf(stderr,"writing AC3%d pack\n",n);
 #endif
-		airbuffer = &mx->index_ac3rbuffer[n];
-		arbuffer = &mx->ac3rbuffer[n];
-		dbuf = &mx->ac3dbuf[n];
-		adelay = mx->ac3pts_off[n];
-		aframesize = mx->ac3frames[n];	
+		as = &mx->ac3stream[n];
 		rest_data = 1; // 4 bytes AC3 header
-		apts = &mx->ac3pts[n];
-		aiu = &mx->ac3iu[n];
 		break;
 
 	default:
 		return;
 	}
+	airbuffer = &as->index_rbuffer;
+	arbuffer = &as->rbuffer;
+	dbuf = &as->dbuf;
+	adelay = as->pts_off;
+	aframesize = as->framesize;	
+	apts = &as->pts;
+	aiu = &as->iu;
 	
 	if (mx->finish != 2 && dummy_space(dbuf) < mx->data_size + rest_data){
 		return;
@@ -420,7 +467,7 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 	switch (aiu->err){
 		
 	case NO_ERR:
-		add = add_to_inbuf(inbuf, arbuffer, inbc, off, aiu->length);
+		add = add_to_inbuf(inbuf, &ninbuf, arbuffer, inbc, off, aiu->length);
 		off += add;
 		inbc += add;
 		break;
@@ -432,9 +479,9 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 	case DUMMY_ERR:
 	  if (aiu->fillframe){
 //		  fprintf(stderr,"1. memcopy 0x%x\n",aiu->fillframe);
-			my_memcpy(inbuf, inbc
-			       , aiu->fillframe + aframesize - length
-				  , length, INSIZE);
+			add_fillframe(inbuf, &ninbuf, inbc
+				      , aiu->fillframe + aframesize - length
+				      , length, INSIZE);
 			inbc += length;
 			fakelength += length;
 		} else fprintf(stderr,"no fillframe \n");
@@ -470,7 +517,7 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 			{
 			case NO_ERR:
 				length += aiu->length;
-				add = add_to_inbuf(inbuf, arbuffer, inbc, off, aiu->length);
+				add = add_to_inbuf(inbuf, &ninbuf, arbuffer, inbc, off, aiu->length);
 				inbc += add;
 				off += add;
 				nframes++;
@@ -487,7 +534,7 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 				length += aframesize;
 				if (aiu->fillframe){
 //					fprintf(stderr,"2. memcopy 0x%x\n",aiu->fillframe);
-					my_memcpy(inbuf, inbc, aiu->fillframe, aframesize, INSIZE);
+					add_fillframe(inbuf, &ninbuf, inbc, aiu->fillframe, aframesize, INSIZE);
 					inbc += aframesize;
 					fakelength += aframesize;
 					nframes++;
@@ -539,19 +586,21 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 		written = bwrite_audio_pes( mx->pack_size, mx->apidn, mx->ac3n
 					   , n, pts, mx->SCR, mx->muxr, 
 					   outbuf, &nlength, PTS_ONLY,
-					   inbuf, inbc);
+					   inbuf, ninbuf, inbc, iov, &iovcnt);
 	else 
 		written = bwrite_ac3_pes( mx->pack_size, mx->apidn, mx->ac3n
 					 , n, pts, mx->SCR, mx->muxr, 
 					 outbuf, &nlength, PTS_ONLY,
 					 nframes, ac3_off,
-					 inbuf, inbc , aiu->length);
+					 inbuf, ninbuf, inbc , aiu->length,
+					 iov, &iovcnt);
 	
 	if (aiu->err == DUMMY_ERR){
 		fakelength -= length-nlength;
 	}
 	length -= nlength;
-	mplx_write(mx, outbuf, written);
+	if (written <= 0) mx->zero_write_count++;
+	else mplx_writev(mx, iov, iovcnt);
 	if (nlength-fakelength+droplength){
 		ring_skip(arbuffer, nlength-fakelength+droplength);
 	}
@@ -560,10 +609,7 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 	aiu->start = ring_rpos(arbuffer);
 
 	if (aiu->length == 0){
-		if (type == MPEG_AUDIO)
-			g = get_next_audio_unit(mx, aiu, n);
-		else
-			g = get_next_ac3_unit(mx, aiu, n);
+		get_next_audio_unit(mx, as);
 	}
 
 
@@ -582,10 +628,7 @@ static void writeout_audio(multiplex_t *mx, int type, int n)
 		lc++;
 		
 		ring_skip(arbuffer, aiu->length);		
-		if (type == MPEG_AUDIO)
-			g = get_next_audio_unit(mx, aiu, n);
-		else
-			g = get_next_ac3_unit(mx, aiu, n);		
+		get_next_audio_unit(mx, as);
 	}
 
 	if (mx->fill_buffers(mx->priv, mx->finish)< 0) {
@@ -604,17 +647,31 @@ static void writeout_padding (multiplex_t *mx)
 	mplx_write(mx, outbuf, mx->pack_size);
 }
 
-void check_times( multiplex_t *mx, int *video_ok, int *audio_ok, int *ac3_ok,
-		  int *start)
+/* step temp_scr back in SCRinc units until SCR + temp_scr lies at most
+   one step beyond 100ms before pts */
+static int64_t limit_extra_scr(multiplex_t *mx, int64_t temp_scr, uint64_t pts)
+{
+	int64_t over;
+	int64_t steps;
+
+	over = ptsdiff(mx->SCR + temp_scr + 100*CLOCK_MS, pts);
+	if (over > 0){
+		steps = (over + mx->SCRinc - 1) / mx->SCRinc;
+		temp_scr -= (steps - 1) * (int64_t)mx->SCRinc;
+	}
+	return temp_scr;
+}
+
+void check_times( multiplex_t *mx, int *start)
 {
 	int i;
+	int st = stats_enter(ST_SCHED);
 	
-	memset(audio_ok, 0, N_AUDIO*sizeof(int));
-	memset(ac3_ok, 0, N_AC3*sizeof(int));
-	*video_ok = 0;
+	stats_add(ST_SCHED, 0, 1);
 	
 	if (mx->fill_buffers(mx->priv, mx->finish)< 0) {
 		fprintf(stderr,"error in get next video unit\n");
+		stats_leave(st);
 		return;
 	}
 
@@ -642,27 +699,13 @@ void check_times( multiplex_t *mx, int *video_ok, int *audio_ok, int *ac3_ok,
 		if (mx->extra_clock > 0.0) {
 			int64_t temp_scr = mx->extra_clock;
 			
-			for (i=0; i<mx->apidn; i++){
-				if (ptscmp(mx->SCR + temp_scr + 100*CLOCK_MS, 
-					   mx->aiu[i].pts) > 0) {
-					while (ptscmp(mx->SCR + temp_scr 
-						      + 100*CLOCK_MS,
-						      mx->aiu[i].pts) > 0) 
-						temp_scr -= mx->SCRinc;
-					temp_scr += mx->SCRinc;
-				}
-			}
+			for (i=0; i<mx->apidn; i++)
+				temp_scr = limit_extra_scr(mx, temp_scr,
+							   mx->astream[i].iu.pts);
 			
-			for (i=0; i<mx->ac3n; i++){
-				if (ptscmp(mx->SCR + temp_scr + 100*CLOCK_MS, 
-					   mx->ac3iu[i].pts) > 0) {
-					while (ptscmp(mx->SCR + temp_scr
-						      + 100*CLOCK_MS,
-						      mx->ac3iu[i].pts) > 0) 
-						temp_scr -= mx->SCRinc;
-					temp_scr += mx->SCRinc;
-				}
-			}
+			for (i=0; i<mx->ac3n; i++)
+				temp_scr = limit_extra_scr(mx, temp_scr,
+							   mx->ac3stream[i].iu.pts);
 			
 			if (temp_scr > 0.0) {
 				mx->SCR += temp_scr;
@@ -673,100 +716,137 @@ void check_times( multiplex_t *mx, int *video_ok, int *audio_ok, int *ac3_ok,
 	}
 
 
-	/* clear decoder buffers up to SCR */
+	/* clear the video decoder buffer up to SCR, the audio buffers are
+	   cleared when their stream is looked at */
 	dummy_delete(&mx->vdbuf, mx->SCR);    
-	
-	for (i=0;i <mx->apidn; i++){
-		dummy_delete(&mx->adbuf[i], mx->SCR);
-		clear_audio(mx, MPEG_AUDIO, i);
-	}
-	for (i=0;i <mx->ac3n; i++) {
-		dummy_delete(&mx->ac3dbuf[i], mx->SCR);
-		clear_audio(mx, AC3, i);
-	}
-	
-	
-	if (dummy_space(&mx->vdbuf) > mx->vsize && mx->viu.length > 0 &&
-	    (ptscmp(mx->viu.dts + mx->video_delay, 1000*CLOCK_MS +mx->oldSCR)<0)
-	    && ring_avail(mx->index_vrbuffer)){
-		*video_ok = 1;
+
+	stats_leave(st);
+}
+
+static audio_stream_t *sched_stream(multiplex_t *mx, sched_entry *e)
+{
+	if (e->type == AC3) return &mx->ac3stream[e->n];
+	return &mx->astream[e->n];
+}
+
+/* Put an audio stream in the heap of the first condition it does not
+   meet yet. None of them can become false again before the stream
+   sends, so it only has to be looked at again when the time its heap
+   is keyed on has passed. */
+static void sched_place(multiplex_t *mx, int type, int n)
+{
+	sched_entry e;
+	audio_stream_t *as;
+
+	e.type = type;
+	e.n = n;
+	as = sched_stream(mx, &e);
+	clear_audio(mx, as);
+	if (!as->iu.length || !ring_avail(&as->index_rbuffer)){
+		mx->idle.e[mx->idle.n++] = e;
+		return;
 	}
-	
-	for (i = 0; i < mx->apidn; i++){
-		if (dummy_space(&mx->adbuf[i]) > mx->asize && 
-		    mx->aiu[i].length > 0 &&
-		    ptscmp(mx->apts[i], 200*CLOCK_MS + mx->oldSCR) < 0
-		    && ring_avail(&mx->index_arbuffer[i])){
-			audio_ok[i] = 1;
-		}
+
+	e.time = as->pts;
+	if (ptscmp(as->pts, mx->audio_lead + mx->oldSCR) >= 0){
+		sched_push(&mx->wait, &e);
+		return;
 	}
-	for (i = 0; i < mx->ac3n; i++){
-		if (dummy_space(&mx->ac3dbuf[i]) > mx->asize && 
-		    mx->ac3iu[i].length > 0 &&
-		    ptscmp(mx->ac3pts[i], 200*CLOCK_MS + mx->oldSCR) < 0
-		    && ring_avail(&mx->index_ac3rbuffer[i])){
-			ac3_ok[i] = 1;
-		}
+
+	dummy_delete(&as->dbuf, mx->SCR);
+	if (dummy_space(&as->dbuf) <= mx->asize){
+		if (dummy_release(&as->dbuf, mx->asize, &e.time) < 0)
+			mx->idle.e[mx->idle.n++] = e;
+		else
+			sched_push(&mx->full, &e);
+		return;
 	}
+
+	sched_push(&mx->ready, &e);
 }
 
-void write_out_packs( multiplex_t *mx, int video_ok, 
-		      int *audio_ok, int *ac3_ok)
+/* Start over with all audio streams idle, they are placed on the next
+   pack after check_times(). */
+static void sched_reset(multiplex_t *mx)
 {
 	int i;
 
-	if (video_ok && !all_audio_ok(audio_ok, mx->apidn) && 
-	    !all_audio_ok(ac3_ok, mx->ac3n)) {
-		writeout_video(mx);  
-	} else { // second case(s): audio ok, video in time
-		int done=0;
-		for ( i = 0; i < mx->ac3n; i++){
-			if ( ac3_ok[i] && !rest_audio_ok(i,ac3_ok, mx->ac3n)			    
-			     && !all_audio_ok(audio_ok, mx->apidn)){
-
-				writeout_audio(mx, AC3, i);
-				done = 1;
-				break;
-			}
-		}
-
-		for ( i = 0; i < mx->apidn && !done; i++){
-			if ( audio_ok[i] && !rest_audio_ok(i, audio_ok, 
-							   mx->apidn)){
-				writeout_audio(mx, MPEG_AUDIO, i);
-				done = 1;
-				break;
-			}
-		}
+	mx->wait.n = mx->full.n = mx->ready.n = 0;
+	mx->idle.n = 0;
+	for (i=0; i < mx->ac3n; i++){
+		mx->idle.e[mx->idle.n].type = AC3;
+		mx->idle.e[mx->idle.n++].n = i;
+	}
+	for (i=0; i < mx->apidn; i++){
+		mx->idle.e[mx->idle.n].type = MPEG_AUDIO;
+		mx->idle.e[mx->idle.n++].n = i;
+	}
+}
 
+static int video_ready(multiplex_t *mx)
+{
+	return dummy_space(&mx->vdbuf) > mx->vsize && mx->viu.length > 0 &&
+		ptscmp(mx->viu.dts + mx->video_delay, 
+		       mx->video_lead + mx->oldSCR) < 0 &&
+		ring_avail(mx->index_vrbuffer);
+}
 
-		if (!done && !mx->VBR){
-			writeout_padding(mx);
-		}
+/* Audio goes before video, as the small audio buffers have to be kept
+   filled while the video buffer can take up the slack, and among the
+   ready audio streams the earliest PTS goes first. */
+void write_out_packs( multiplex_t *mx)
+{
+	sched_entry e;
+	int i, nidle;
+	int sent = 1;
+	int st = stats_enter(ST_PACK);
+
+	nidle = mx->idle.n;
+	mx->idle.n = 0;
+	for (i = 0; i < nidle; i++)
+		sched_place(mx, mx->idle.e[i].type, mx->idle.e[i].n);
+	while (mx->wait.n && ptscmp(mx->wait.e[0].time, 
+				    mx->audio_lead + mx->oldSCR) < 0){
+		sched_pop(&mx->wait, &e);
+		sched_place(mx, e.type, e.n);
 	}
-	
+	while (mx->full.n && ptscmp(mx->full.e[0].time, mx->SCR) < 0){
+		sched_pop(&mx->full, &e);
+		sched_place(mx, e.type, e.n);
+	}
+
+	if (sched_pop(&mx->ready, &e)){
+		dummy_delete(&sched_stream(mx, &e)->dbuf, mx->SCR);
+		writeout_audio(mx, e.type, e.n);
+		sched_place(mx, e.type, e.n);
+	} else if (video_ready(mx)){
+		writeout_video(mx);
+	} else if (!mx->VBR){
+		writeout_padding(mx);
+	} else sent = 0;
+
+	if (sent) stats_add(ST_PACK, 0, 1);
+	stats_leave(st);
 }
 
 void finish_mpg(multiplex_t *mx)
 {
 	int start=0;
-	int video_ok = 0;
-	int audio_ok[N_AUDIO];
-	int ac3_ok[N_AC3];
         int n,nn,old,i;
         uint8_t mpeg_end[4] = { 0x00, 0x00, 0x01, 0xB9 };
                                                                                 
-        memset(audio_ok, 0, N_AUDIO*sizeof(int));
-        memset(ac3_ok, 0, N_AC3*sizeof(int));
         mx->finish = 1;
+        /* this may be called from fill_buffers() while write_out_packs()
+           has a stream out of the heaps */
+        sched_reset(mx);
                                                                                 
         old = 0;nn=0;
         while ((n=buffers_filled(mx)) && nn<20 ){
                 if (n== old) nn++;
                 else if (nn) nn--;
                 old = n;
-                check_times( mx, &video_ok, audio_ok, ac3_ok, &start);
-                write_out_packs( mx, video_ok, audio_ok, ac3_ok);
+                check_times( mx, &start);
+                write_out_packs( mx);
         }
 
         old = 0;nn=0;
@@ -782,7 +862,8 @@ void finish_mpg(multiplex_t *mx)
         mx->finish = 2;
         old = 0;nn=0;
 	for (i = 0; i < mx->apidn; i++){
-		while ((n=ring_avail(&mx->index_arbuffer[i])/sizeof(index_unit))
+		while ((n=ring_avail(&mx->astream[i].index_rbuffer)
+			/sizeof(index_unit))
 		       && nn <10){
 			if (n== old) nn++;
 			else if (nn) nn--;
@@ -793,7 +874,7 @@ void finish_mpg(multiplex_t *mx)
 	
         old = 0;nn=0;
 	for (i = 0; i < mx->ac3n; i++){
-		while ((n=ring_avail(&mx->index_ac3rbuffer[i])
+		while ((n=ring_avail(&mx->ac3stream[i].index_rbuffer)
 			/sizeof(index_unit))
 			&& nn<10){
 			if (n== old) nn++;
@@ -809,33 +890,33 @@ void finish_mpg(multiplex_t *mx)
 }
 
 
-void init_multiplex( multiplex_t *mx, sequence_t *seq_head, audio_frame_t *aframe,
-		     audio_frame_t *ac3frame, int apidn, int ac3n, 
-		     uint64_t video_delay, uint64_t audio_delay, int fd,
-		     int (*fill_buffers)(void *p, int f),
-		     ringbuffer *vrbuffer, ringbuffer *index_vrbuffer,	
-		     ringbuffer *arbuffer, ringbuffer *index_arbuffer,
-		     ringbuffer *ac3rbuffer, ringbuffer *index_ac3rbuffer,
-		     int otype)
+/* the settings of the output type and the rate the streams need,
+   everything of init_multiplex that does not touch the streams */
+void mux_limits(multiplex_t *mx, sequence_t *seq_head,
+		audio_stream_t *astream, audio_stream_t *ac3stream,
+		int apidn, int ac3n, int otype, int low_latency)
 {
 	int i;
 	uint32_t data_rate;
+	uint64_t startup;
 
-	mx->fill_buffers = fill_buffers;
-	mx->video_delay = video_delay;
-	mx->audio_delay = audio_delay;
-	mx->fd_out = fd;
 	mx->otype = otype;
-	mx->total_written = 0;
-	mx->zero_write_count = 0;
-	mx->max_write = 0;
-	mx->max_reached = 0;
+	mx->low_latency = low_latency;
+	if (low_latency){
+		startup = LL_STARTUP_DELAY;
+		mx->video_lead = LL_VIDEO_LEAD;
+		mx->audio_lead = LL_AUDIO_LEAD;
+	} else {
+		startup = STARTUP_DELAY;
+		mx->video_lead = VIDEO_LEAD;
+		mx->audio_lead = AUDIO_LEAD;
+	}
 
 	switch(mx->otype){
 
 	case REPLEX_DVD:
-		mx->video_delay += 180*CLOCK_MS;
-		mx->audio_delay += 180*CLOCK_MS;
+		mx->video_delay += startup;
+		mx->audio_delay += startup;
 		mx->pack_size = 2048;
 		mx->audio_buffer_size = 4*1024;
 		mx->video_buffer_size = 232*1024;
@@ -851,8 +932,8 @@ void init_multiplex( multiplex_t *mx, sequence_t *seq_head, audio_frame_t *afram
 
 
 	case REPLEX_MPEG2:
-		mx->video_delay += 180*CLOCK_MS;
-		mx->audio_delay += 180*CLOCK_MS;
+		mx->video_delay += startup;
+		mx->audio_delay += startup;
 		mx->pack_size = 2048;
 		mx->audio_buffer_size = 4*1024;
 		mx->video_buffer_size = 224*1024;
@@ -866,8 +947,8 @@ void init_multiplex( multiplex_t *mx, sequence_t *seq_head, audio_frame_t *afram
 		break;
 
 	case REPLEX_HDTV:
-		mx->video_delay += 180*CLOCK_MS;
-		mx->audio_delay += 180*CLOCK_MS;
+		mx->video_delay += startup;
+		mx->audio_delay += startup;
 		mx->pack_size = 2048;
 		mx->audio_buffer_size = 4*1024;
 		mx->video_buffer_size = 4*224*1024;
@@ -881,41 +962,61 @@ void init_multiplex( multiplex_t *mx, sequence_t *seq_head, audio_frame_t *afram
 		break;
 	}
 
+	mx->data_size = mx->pack_size - PES_H_MIN -10; 
+	mx->vsize = mx->data_size;
+	mx->asize = mx->data_size+5; // one less DTS
+	
+	data_rate = seq_head->bit_rate *400;
+	for ( i = 0; i < apidn; i++)
+		data_rate += astream[i].frame.bit_rate;
+	for ( i = 0; i < ac3n; i++)
+		data_rate += ac3stream[i].frame.bit_rate;
+
+	
+	mx->muxr = (data_rate / 8 * mx->pack_size) / mx->data_size; 
+                                     // muxrate of payload in Byte/s
+}
+
+void init_multiplex( multiplex_t *mx, sequence_t *seq_head, 
+		     audio_stream_t *astream, audio_stream_t *ac3stream,
+		     int apidn, int ac3n, 
+		     uint64_t video_delay, uint64_t audio_delay, int fd,
+		     int (*fill_buffers)(void *p, int f),
+		     ringbuffer *vrbuffer, ringbuffer *index_vrbuffer,	
+		     int otype, int low_latency)
+{
+	int i;
+
+	mx->fill_buffers = fill_buffers;
+	mx->video_delay = video_delay;
+	mx->audio_delay = audio_delay;
+	mx->fd_out = fd;
+	mx->total_written = 0;
+	mx->zero_write_count = 0;
+	mx->max_write = 0;
+	mx->max_reached = 0;
+	mux_limits(mx, seq_head, astream, ac3stream, apidn, ac3n,
+		   otype, low_latency);
+
 	mx->apidn = apidn;
 	mx->ac3n = ac3n;
 
 
 	mx->vrbuffer = vrbuffer;
 	mx->index_vrbuffer = index_vrbuffer;
-	mx->arbuffer = arbuffer;
-	mx->index_arbuffer = index_arbuffer;
-	mx->ac3rbuffer = ac3rbuffer;
-	mx->index_ac3rbuffer = index_ac3rbuffer;
+	mx->astream = astream;
+	mx->ac3stream = ac3stream;
 
 	dummy_init(&mx->vdbuf, mx->video_buffer_size);
 	for (i=0; i<mx->apidn;i++){
-		mx->apts_off[i] = 0;
-		dummy_init(&mx->adbuf[i],mx->audio_buffer_size);
+		mx->astream[i].pts_off = 0;
+		dummy_init(&mx->astream[i].dbuf,mx->audio_buffer_size);
 	}
 	for (i=0; i<mx->ac3n;i++){
-		mx->ac3pts_off[i] = 0;
-		dummy_init(&mx->ac3dbuf[i], mx->audio_buffer_size);
+		mx->ac3stream[i].pts_off = 0;
+		dummy_init(&mx->ac3stream[i].dbuf, mx->audio_buffer_size);
 	}
 
-	mx->data_size = mx->pack_size - PES_H_MIN -10; 
-	mx->vsize = mx->data_size;
-	mx->asize = mx->data_size+5; // one less DTS
-	
-	data_rate = seq_head->bit_rate *400;
-	for ( i = 0; i < mx->apidn; i++)
-		data_rate += aframe[i].bit_rate;
-	for ( i = 0; i < mx->ac3n; i++)
-		data_rate += ac3frame[i].bit_rate;
-
-	
-	mx->muxr = (data_rate / 8 * mx->pack_size) / mx->data_size; 
-                                     // muxrate of payload in Byte/s
-
 	if (mx->mux_rate) {
 		if ( mx->mux_rate < mx->muxr)
                         fprintf(stderr, "data rate may be to high for required mux rate\n");
@@ -935,16 +1036,20 @@ void setup_multiplex(multiplex_t *mx)
 
  	get_next_video_unit(mx, &mx->viu);
 	for (i=0; i < mx->apidn; i++){
-		get_next_audio_unit(mx, &mx->aiu[i], i);
-		mx->apts[i] = uptsdiff(mx->aiu[i].pts +mx->audio_delay, 
-				       mx->apts_off[i]); 
+		audio_stream_t *as = &mx->astream[i];
+
+		get_next_audio_unit(mx, as);
+		as->pts = uptsdiff(as->iu.pts +mx->audio_delay, as->pts_off); 
 	}
 	for (i=0; i < mx->ac3n; i++){
-		get_next_ac3_unit(mx, &mx->ac3iu[i], i);
-		mx->ac3pts[i] = uptsdiff(mx->ac3iu[i].pts +mx->audio_delay, 
-					 mx->ac3pts_off[i]); 
+		audio_stream_t *as = &mx->ac3stream[i];
+
+		get_next_audio_unit(mx, as);
+		as->pts = uptsdiff(as->iu.pts +mx->audio_delay, as->pts_off); 
 	}
 
+	sched_reset(mx);
+
 	packlen = mx->pack_size;
 
 	mx->SCR = 0;
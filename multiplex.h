@@ -31,10 +31,65 @@
 #include "mpg_common.h"
 #include "pes.h"
 #include "element.h"
+#include "ts.h"
 
 #define N_AUDIO 32
 #define N_AC3 8
+#define MAXFRAME 2000
 
+/* decoder startup delay and how far ahead of the SCR video and audio
+   packs may be sent, normally and with the low latency profile */
+#define STARTUP_DELAY    (180*CLOCK_MS)
+#define VIDEO_LEAD       (1000*CLOCK_MS)
+#define AUDIO_LEAD       (200*CLOCK_MS)
+#define LL_STARTUP_DELAY (60*CLOCK_MS)
+#define LL_VIDEO_LEAD    (300*CLOCK_MS)
+#define LL_AUDIO_LEAD    (200*CLOCK_MS)
+
+/* one selected audio stream (MPEG audio or AC3), shared between the
+   demultiplexing side in replex.c and the multiplexer */
+typedef struct audio_stream_s{
+	int type;
+	uint16_t id;
+
+	/* input side */
+	pes_in_t pes;
+	ts_pid_t ts;
+	index_unit current_index;
+	int pes_abort;
+	ringbuffer rbuffer;
+	ringbuffer index_rbuffer;
+	uint64_t frame_count;
+	audio_frame_t frame;
+	uint64_t first_pts;
+	uint64_t last_pts;
+	int state;
+	uint64_t jump;
+	uint32_t clock;
+	uint64_t pts_off;
+	int filled;
+
+	/* output side */
+	index_unit iu;
+	uint64_t pts;
+	int framesize;
+	dummy_buffer dbuf;
+
+	uint8_t fillframe[MAXFRAME];
+} audio_stream_t;
+
+
+/* an audio stream in the pack schedule, queued by time */
+typedef struct sched_entry_s{
+	uint64_t time;
+	int type;
+	int n;
+} sched_entry;
+
+typedef struct sched_heap_s{
+	sched_entry e[N_AUDIO+N_AC3];
+	int n;
+} sched_heap;
 
 typedef struct multiplex_s{
 	int fd_out;
@@ -63,40 +118,36 @@ typedef struct multiplex_s{
 	int write_end_codes;
 	int set_broken_link;
 	int vsize, asize;
+	int low_latency;
+	uint64_t video_lead;
+	uint64_t audio_lead;
 	int64_t extra_clock;
 	uint64_t first_vpts;
-	uint64_t first_apts[N_AUDIO];
-	uint64_t first_ac3pts[N_AC3];
 	
 	uint64_t SCR;
 	uint64_t oldSCR;
 	uint64_t SCRinc;
 	index_unit viu;
-	index_unit aiu[N_AUDIO];
-	index_unit ac3iu[N_AC3];
-	uint64_t apts[N_AUDIO];
-	uint64_t ac3pts[N_AC3];
-	uint64_t ac3pts_off[N_AC3];
-	uint64_t apts_off[N_AUDIO];
-	int aframes[N_AUDIO];
-	int ac3frames[N_AUDIO];
-	int total_written;
+	uint64_t total_written;
 	int zero_write_count;
 	int max_write;
 	int max_reached;
+	uint64_t lat_sum;     // input to output delay of the frames in us
+	uint64_t lat_max;
+	int lat_n;
 
 /* needed from replex */
 	int apidn;
 	int ac3n;
 
 	dummy_buffer vdbuf;
-	dummy_buffer adbuf[N_AUDIO];
-	dummy_buffer ac3dbuf[N_AC3];
 
-	ringbuffer *ac3rbuffer;
-	ringbuffer *index_ac3rbuffer;
-	ringbuffer *arbuffer;
-	ringbuffer *index_arbuffer;
+	audio_stream_t *astream;
+	audio_stream_t *ac3stream;
+	sched_heap wait;      // until the PTS is within audio_lead
+	sched_heap full;      // until the STD buffer has room
+	sched_heap ready;     // by PTS
+	sched_heap idle;      // no data, checked on every pack
 	ringbuffer *vrbuffer;
 	ringbuffer *index_vrbuffer;
 
@@ -104,19 +155,19 @@ typedef struct multiplex_s{
 	void *priv;
 } multiplex_t;
 
-void check_times( multiplex_t *mx, int *video_ok, int *audio_ok, int *ac3_ok,
-		  int *start);
-void write_out_packs( multiplex_t *mx, int video_ok, 
-		      int *audio_ok, int *ac3_ok);
+void check_times( multiplex_t *mx, int *start);
+void write_out_packs( multiplex_t *mx);
 void finish_mpg(multiplex_t *mx);
-void init_multiplex( multiplex_t *mx, sequence_t *seq_head, audio_frame_t *aframe,
-		     audio_frame_t *ac3frame, int apidn, int ac3n,	
+void init_multiplex( multiplex_t *mx, sequence_t *seq_head, 
+		     audio_stream_t *astream, audio_stream_t *ac3stream,
+		     int apidn, int ac3n,	
 		     uint64_t video_delay, uint64_t audio_delay, int fd,
 		     int (*fill_buffers)(void *p, int f),
 		     ringbuffer *vrbuffer, ringbuffer *index_vrbuffer,	
-		     ringbuffer *arbuffer, ringbuffer *index_arbuffer,
-		     ringbuffer *ac3rbuffer, ringbuffer *index_ac3rbuffer,
-		     int otype);
+		     int otype, int low_latency);
 
+void mux_limits(multiplex_t *mx, sequence_t *seq_head,
+		audio_stream_t *astream, audio_stream_t *ac3stream,
+		int apidn, int ac3n, int otype, int low_latency);
 void setup_multiplex(multiplex_t *mx);
 #endif /* _MULTIPLEX_H_*/
@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include "pes.h"
+#include "fuzz.h"
 
 //#define PES_DEBUG
 
@@ -146,8 +147,8 @@ void init_pes_in(pes_in_t *p, int t, ringbuffer *rb, int wi){
 	p->withbuf = wi;
 	
 	if (p->withbuf && !p->buf){
-		p->buf = malloc(MAX_PLENGTH*sizeof(uint8_t));
-		memset(p->buf,0,MAX_PLENGTH*sizeof(uint8_t));
+		p->buf = malloc(PES_BUF_SIZE*sizeof(uint8_t));
+		memset(p->buf,0,PES_BUF_SIZE*sizeof(uint8_t));
 	} else if (rb) p->rbuf = rb;
 	if (p->rbuf) p->ini_pos = ring_wpos(p->rbuf); 
         p->done = 0;
@@ -156,7 +157,85 @@ void init_pes_in(pes_in_t *p, int t, ringbuffer *rb, int wi){
 }
 
 
-void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
+/* PTS and DTS have to fit into the header data */
+static int pes_header_bad(uint8_t flag2, uint8_t hlength)
+{
+	if ((flag2 & PTS_DTS) == PTS_DTS) return hlength < 10;
+	if (flag2 & PTS_ONLY) return hlength < 5;
+	return 0;
+}
+
+/* Fast path for the common case of a complete MPEG2 PES header at the
+   start of buf: all fields are taken with direct loads and the state
+   is left as if the byte-wise parser had read up to PTS/DTS. Returns
+   the number of bytes used or 0 to leave it to the state machine. */
+static int get_pes_header(pes_in_t *p, uint8_t *buf, int count)
+{
+	uint8_t *h;
+	int plength;
+	int n = 9;
+
+	if (count < 9 || buf[0] || buf[1] || buf[2] != 0x01) return 0;
+	switch (buf[3]){
+	case PRIVATE_STREAM1:
+	case VIDEO_STREAM_S ... VIDEO_STREAM_E:
+	case AUDIO_STREAM_S ... AUDIO_STREAM_E:
+		break;
+	default:
+		return 0;
+	}
+	if ((buf[6] & 0xC0) != 0x80) return 0;
+
+	if (buf[7] & PTS_ONLY) n = 14;
+	if ((buf[7] & PTS_DTS) == PTS_DTS) n = 19;
+	plength = (buf[4] << 8) | buf[5];
+	if (pes_header_bad(buf[7], buf[8]) || count < 9+buf[8] || 
+	    (plength && plength+6 < 9+buf[8])) return 0;
+
+	p->cid = buf[3];
+	p->plen[0] = buf[4];
+	p->plen[1] = buf[5];
+	p->plength = plength;
+	p->flag1 = buf[6];
+	p->flag2 = buf[7];
+	p->hlength = buf[8];
+	p->mpeg = 2;
+	if (n >= 14) memcpy(p->pts, buf+9, 5);
+	if (n == 19) memcpy(p->dts, buf+14, 5);
+
+	h = p->withbuf ? p->buf : p->hbuf;
+	memcpy(h, buf, n);
+	p->found = n;
+
+	return n;
+}
+
+/* Number of payload bytes that can be appended to the ring of p without
+   completing the PES packet, 0 if get_pes has to see the data. */
+int pes_payload_room(pes_in_t *p)
+{
+	if (p->withbuf || p->done || p->mpeg != 2 || 
+	    p->found < p->hlength+9) return 0;
+	if ((p->flag2 & PTS_ONLY) && p->found < 14) return 0;
+	if ((p->flag2 & PTS_DTS) == PTS_DTS && p->found < 19) return 0;
+
+	switch (p->cid){
+	case AUDIO_STREAM_S ... AUDIO_STREAM_E:			
+	case VIDEO_STREAM_S ... VIDEO_STREAM_E:
+	case PRIVATE_STREAM1:
+		break;
+	default:
+		return 0;
+	}
+	if (p->found >= p->plength+6) return 0;
+
+	return p->plength+6 - p->found - 1;
+}
+
+/* Parses up to the end of the current PES packet, returns the number
+   of bytes used. */
+static int get_pes_packet(pes_in_t *p, uint8_t *buf, int count, 
+			  void (*func)(pes_in_t *p))
 {
 
 	int l=0;
@@ -167,8 +246,19 @@ void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 	while (c < count && (!p->mpeg ||
 			     (p->mpeg == 2 && p->found < 9))
 	       &&  (p->found < 5 || !p->done)){
+		FUZZ_WORK(1);
 		switch ( p->found ){
 		case 0:
+			if ((l = get_pes_header(p, buf+c, count-c))){
+				c += l;
+				break;
+			}
+			if (buf[c]){
+				uint8_t *z = memchr(buf+c, 0x00, count-c);
+				FUZZ_WORK((z ? z-buf : count) - c);
+				c = z ? z-buf : count;
+				break;
+			}
 		case 1:
 			if (buf[c] == 0x00) p->found++;
 			else p->found = 0;
@@ -222,7 +312,7 @@ void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 			} else {
 				p->plen[0] = buf[c];
 				p->found++;
-				return;
+				return count;
 			}
 			break;
 		case 5:
@@ -267,13 +357,16 @@ void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 
 			break;
 		}
-		if(p->plength && p->found == 9 && p->found > p->plength+6){
+		if(p->found == 9 && !p->done && 
+		   (pes_header_bad(p->flag2, p->hlength) ||
+		    (p->plength && p->hlength+3 > p->plength))){
 			fprintf(stderr, "Error in PES Header 0x%2x\n",p->cid);
 			p->found = 0;
 		}
 	}
 
-	if (!p->plength) p->plength = MMAX_PLENGTH-6;
+	if (!p->plength) 
+		p->plength = p->withbuf ? MAX_PLENGTH : MMAX_PLENGTH-6;
 
 
 	if ( p->done || (p->mpeg == 2 && p->found >= 9) ){
@@ -315,7 +408,7 @@ void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 					c++;
 					p->found++;
 				}
-				if (c == count) return;
+				if (c == count) return count;
 			}
 
 			if (((p->flag2 & PTS_DTS) == 0xC0) && p->found < 19){
@@ -328,7 +421,7 @@ void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 					c++;
 					p->found++;
 				}
-				if (c == count) return;
+				if (c == count) return count;
 			}
 
 
@@ -341,6 +434,7 @@ void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 				else {
 					if ( p->found < p->hlength+9 ){
 						int rest = p->hlength+9-p->found;
+						if (rest > l) rest = l;
 						memcpy(p->hbuf+p->found, buf+c, rest);
 						if (ring_write(p->rbuf, buf+c+rest, 
 							       l-rest) <0){
@@ -380,11 +474,19 @@ void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
 
 		if (p->plength && p->found == p->plength+6) {
 			init_pes_in(p, p->type, NULL, p->withbuf);
-			if (c < count)
-				get_pes(p, buf+c, count-c, func);
+			return c;
 		}
 	}
-	return;
+	return count;
+}
+
+void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p))
+{
+	int c = 0;
+	int n;
+
+	while (c < count && (n = get_pes_packet(p, buf+c, count-c, func)) > 0)
+		c += n;
 }
 
 
@@ -684,11 +786,44 @@ void write_padding_pes( int pack_size, int apidn, int ac3n,
 
 }
 
+/* The pack is handed out as iovecs: the headers in buf, the payload
+   referenced where it lies and the padding PES written behind the
+   headers in buf. */
+static int pack_iov(struct iovec *iov, uint8_t *buf, int hlength,
+		    struct iovec *data, int ndata, int dlength, int plength)
+{
+	int i, n=0;
+
+	iov[n].iov_base = buf;
+	iov[n++].iov_len = hlength;
+	for (i=0; i < ndata && dlength > 0; i++){
+		int l = data[i].iov_len;
+
+		if (l > dlength) l = dlength;
+		if (!l) continue;
+		iov[n].iov_base = data[i].iov_base;
+		iov[n++].iov_len = l;
+		dlength -= l;
+	}
+	if (plength){
+		iov[n].iov_base = buf+hlength;
+		iov[n++].iov_len = plength;
+	}
+	return n;
+}
+
+/* the payload is only referenced, the caller skips it in vrbuffer after
+   the pack is written */
 int write_video_pes( int pack_size, int apidn, int ac3n, uint64_t vpts, 
 		     uint64_t vdts, uint64_t SCR, uint64_t muxr, 
 		     uint8_t *buf, int *vlength, 
-		     uint8_t ptsdts, ringbuffer *vrbuffer)
+		     uint8_t ptsdts, ringbuffer *vrbuffer,
+		     struct iovec *iov, int *iovcnt)
 {
+	struct iovec data[2];
+	int ndata;
+	int hlength;
+	int plength = 0;
 	int add;
 	int pos = 0;
 	int p   = 0;
@@ -729,16 +864,19 @@ int write_video_pes( int pack_size, int apidn, int ac3n, uint64_t vpts,
 			*vlength);
 	}
 
-	add = ring_read( vrbuffer, buf+pos, length-pos);
+	if ((ndata = ring_peek_iov( vrbuffer, data, length-pos, 0)) < 0)
+		return -1;
+	add = length-pos;
 	*vlength = add;
-	if (add < 0) return -1;
+	hlength = pos;
 	pos += add;
 
 	if (pos+PES_MIN < pack_size){
-		pos += write_pes_header( PADDING_STREAM, pack_size-pos, 0, 0,
-					 buf+pos, 0, 0);
+		plength = write_pes_header( PADDING_STREAM, pack_size-pos, 0, 0,
+					    buf+hlength, 0, 0);
 		pos = pack_size;
 	}		
+	*iovcnt = pack_iov(iov, buf, hlength, data, ndata, add, plength);
 	return pos;
 }
 
@@ -864,9 +1002,12 @@ int write_ac3_pes(  int pack_size, int apidn, int ac3n, int n,
 
 int bwrite_audio_pes(  int pack_size, int apidn, int ac3n, int n, uint64_t pts, 
 		      uint64_t SCR, uint32_t muxr, uint8_t *buf, int *alength, 
-		       uint8_t ptsdts, uint8_t *arbuffer, int bsize )
+		       uint8_t ptsdts, struct iovec *data, int ndata, int bsize,
+		       struct iovec *iov, int *iovcnt)
 {
 	int add;
+	int hlength;
+	int plength = 0;
 	int pos = 0;
 	int p   = 0;
 	int stuff = 0;
@@ -900,22 +1041,23 @@ int bwrite_audio_pes(  int pack_size, int apidn, int ac3n, int n, uint64_t pts,
 				 ptsdts);
 
 	if (length -pos < bsize){
-		memcpy(buf+pos, arbuffer, length-pos);
 		add = length - pos;
 		*alength = add;
 	} else  return -1;
 	
+	hlength = pos;
 	pos += add;
 
 	if (pos+PES_MIN < pack_size){
-		pos += write_pes_header( PADDING_STREAM, pack_size-pos, 0,0,
-					 buf+pos, 0, 0);
+		plength = write_pes_header( PADDING_STREAM, pack_size-pos, 0,0,
+					    buf+hlength, 0, 0);
 		pos = pack_size;
 	}		
 	if (pos != pack_size) {
 		fprintf(stderr,"apos: %d\n",pos);
 		exit(1);
 	}
+	*iovcnt = pack_iov(iov, buf, hlength, data, ndata, add, plength);
 
 	return pos;
 }
@@ -925,9 +1067,12 @@ int bwrite_audio_pes(  int pack_size, int apidn, int ac3n, int n, uint64_t pts,
 int bwrite_ac3_pes(  int pack_size, int apidn, int ac3n, int n,
 		    uint64_t pts, uint64_t SCR, 
 		    uint32_t muxr, uint8_t *buf, int *alength, uint8_t ptsdts,
-		     int nframes,int ac3_off, uint8_t *ac3rbuffer, int bsize, int framelength)
+		     int nframes,int ac3_off, struct iovec *data, int ndata, 
+		     int bsize, int framelength, struct iovec *iov, int *iovcnt)
 {
 	int add;
+	int hlength;
+	int plength = 0;
 	int pos = 0;
 	int p   = 0;
 	int stuff = 0;
@@ -967,21 +1112,22 @@ int bwrite_ac3_pes(  int pack_size, int apidn, int ac3n, int n,
 	pos += 4;
 
 	if (length-pos <= bsize){
-		memcpy(buf+pos, ac3rbuffer, length-pos);
 		add = length-pos;
 		*alength = add;
 	} else return -1;
+	hlength = pos;
 	pos += add;
 
 	if (pos+PES_MIN < pack_size){
-		pos += write_pes_header( PADDING_STREAM, pack_size-pos, 0,0,
-					 buf+pos, 0, 0);
+		plength = write_pes_header( PADDING_STREAM, pack_size-pos, 0,0,
+					    buf+hlength, 0, 0);
 		pos = pack_size;
 	}		
 	if (pos != pack_size) {
 		fprintf(stderr,"apos: %d\n",pos);
 		exit(1);
 	}
+	*iovcnt = pack_iov(iov, buf, hlength, data, ndata, add, plength);
 
 	return pos;
 }
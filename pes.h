@@ -31,12 +31,14 @@
 #define _PES_H_
 
 #include <stdint.h>
+#include <sys/uio.h>
 #include "ringbuffer.h"
 
 #define PS_HEADER_L1    14
 #define PS_HEADER_L2    (PS_HEADER_L1+24)
 #define PES_MIN         7
 #define PES_H_MIN       9
+#define PACK_IOV        4   // headers, payload (2), padding
 
 #define SYSTEM_START_CODE_S   0xB9
 #define SYSTEM_START_CODE_E   0xFF
@@ -71,6 +73,7 @@
 
 #define MAX_PLENGTH 0xFFFF
 #define MMAX_PLENGTH (8*MAX_PLENGTH)
+#define PES_BUF_SIZE (MAX_PLENGTH+6)   // withbuf: header and payload
 
 #define MAX_PTS (0x0000000200000000ULL)
 #define MAX_PTS2 (300* MAX_PTS)
@@ -117,6 +120,7 @@ struct pes_in_s{
 
 void init_pes_in(pes_in_t *p, int type, ringbuffer *rb, int wi);
 void get_pes (pes_in_t *p, uint8_t *buf, int count, void (*func)(pes_in_t *p));
+int pes_payload_room(pes_in_t *p);
 void printpts(int64_t pts);
 void printptss(int64_t pts);
 int64_t ptsdiff(uint64_t pts1, uint64_t pts2);
@@ -134,17 +138,20 @@ int write_ac3_pes(  int pack_size, int apidn, int ac3n, int n, uint64_t pts,
 int bwrite_ac3_pes(  int pack_size, int apidn, int ac3n, int n, uint64_t pts, 
 		    uint64_t SCR, 
 		    uint32_t muxr, uint8_t *buf, int *alength, uint8_t ptsdts,
-		     int nframes,int ac3_off, uint8_t *ac3rbuffer, int bsize, int framelength);
+		     int nframes,int ac3_off, struct iovec *data, int ndata, 
+		     int bsize, int framelength, struct iovec *iov, int *iovcnt);
 int write_audio_pes(  int pack_size, int apidn, int ac3n, int n, uint64_t pts, 
 		      uint64_t SCR, uint32_t muxr, uint8_t *buf, int *alength, 
 		      uint8_t ptsdts, 	ringbuffer *arbuffer);
 int bwrite_audio_pes(  int pack_size, int apidn, int ac3n, int n, uint64_t pts, 
 		      uint64_t SCR, uint32_t muxr, uint8_t *buf, int *alength, 
-		       uint8_t ptsdts, uint8_t *arbuffer, int bsize );
+		       uint8_t ptsdts, struct iovec *data, int ndata, int bsize,
+		       struct iovec *iov, int *iovcnt);
 int write_video_pes( int pack_size, int apidn, int ac3n, uint64_t vpts, 
 		     uint64_t vdts, uint64_t SCR, uint64_t muxr, 
 		     uint8_t *buf, int *vlength, 
-		     uint8_t ptsdts, ringbuffer *vrbuffer);
+		     uint8_t ptsdts, ringbuffer *vrbuffer, 
+		     struct iovec *iov, int *iovcnt);
 int write_nav_pack(int pack_size, int apidn, int ac3n, uint64_t SCR, uint32_t muxr, 
 		   uint8_t *buf);
 
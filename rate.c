@@ -0,0 +1,504 @@
+/*
+ * rate.c: bitrate, VBV and STD profile of the units found with -y
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rate.h"
+#include "analyze.h"
+#include "element.h"
+#include "pes.h"
+
+#define RATE_STREAMS (1+N_AUDIO+N_AC3)
+#define RATE_SEC     (1000*CLOCK_MS)
+#define RATE_JUMP    (1000*CLOCK_MS)   // larger steps are PTS jumps
+#define RATE_BASE    (10*RATE_SEC)     // keeps the dummy_buffer times positive
+#define RATE_PTS_TICK 300              // 90kHz rounding of the time stamps
+
+typedef struct rate_au_s{
+	int64_t t;              // decode time on the time line
+	uint32_t left;          // bytes not sent by the multiplexer yet
+} rate_au;
+
+typedef struct rate_sec_s{
+	uint64_t video;
+	uint64_t audio;
+	uint32_t vbv_min;       // VBV fill after a picture was removed
+	int vbv_under;
+	int late;
+	int64_t late_max;
+} rate_sec;
+
+typedef struct rate_stream_s{
+	int used;
+	uint64_t last_raw;      // last time stamp
+	int64_t t_raw;          // its time on the time line
+	int64_t t;              // decode time of the last unit
+	int64_t period;         // time of one unit, once it was seen twice
+	int64_t cand;
+	int since;
+	int64_t shift;          // audio delay relative to the video
+
+	rate_au *q;
+	int qhead;
+	int qlen;
+	int qsize;
+	int vbv_next;           // first picture not on the time line yet
+
+	dummy_buffer dbuf;
+	uint32_t payload;
+	int64_t lead;
+} rate_stream;
+
+static rate_stream rs[RATE_STREAMS];
+static rate_sec *secs;
+static int nsecs;
+static int asecs;
+static int64_t first_sec;
+
+static int limits;
+static multiplex_t mx;
+static uint32_t need_rate;      // mux rate the streams need in byte/s
+static uint64_t bit_rate;
+static uint32_t vbv_size;
+static int64_t frame_period;
+static uint64_t vframes;
+
+static int origin_set;
+static uint64_t origin;
+
+static int vbv_started;
+static int64_t vbv;
+static int64_t vbv_t;
+
+static int mux_started;
+static int64_t scr;
+static int64_t scrinc;
+
+static uint64_t frames;
+static uint64_t units;
+static uint64_t vbv_unders;
+static uint64_t lates;
+static int64_t late_max;
+
+static void secs_grow(int n)
+{
+	int a = asecs ? asecs : 64;
+
+	if (n <= asecs) return;
+	while (a < n) a *= 2;
+	if (!(secs = realloc(secs, a*sizeof(rate_sec)))){
+		fprintf(stderr,"Not enough memory for rate profile\n");
+		exit(1);
+	}
+	memset(secs+asecs, 0, (a-asecs)*sizeof(rate_sec));
+	for (n = asecs; n < a; n++) secs[n].vbv_min = UINT32_MAX;
+	asecs = a;
+}
+
+// the second of a time, the first one may still move to the front
+static rate_sec *sec_at(int64_t t)
+{
+	int64_t i = t >= 0 ? t/RATE_SEC : -((RATE_SEC-1-t)/RATE_SEC);
+
+	if (!nsecs) first_sec = i;
+	if (i < first_sec){
+		int n = first_sec - i;
+		int j;
+
+		secs_grow(nsecs + n);
+		memmove(secs+n, secs, nsecs*sizeof(rate_sec));
+		memset(secs, 0, n*sizeof(rate_sec));
+		for (j = 0; j < n; j++) secs[j].vbv_min = UINT32_MAX;
+		nsecs += n;
+		first_sec = i;
+	}
+	i -= first_sec;
+	secs_grow(i+1);
+	if (i >= nsecs) nsecs = i+1;
+	return &secs[i];
+}
+
+/* Units without a time stamp of their own, e.g. the further audio
+   frames of a PES, follow the last one by the measured period. Jumps
+   of the time stamps are left out of the time line. */
+static int unit_time(rate_stream *s, uint64_t raw, int64_t *t)
+{
+	int64_t delta, per;
+
+	if (!s->used){
+		if (!raw) return -1;
+		if (!origin_set){
+			origin = raw;
+			origin_set = 1;
+		}
+		s->used = 1;
+		s->last_raw = raw;
+		s->since = 0;
+		s->t_raw = s->t = ptsdiff(raw, origin);
+		*t = s->t;
+		return 0;
+	}
+
+	s->since++;
+	if (!raw || raw == s->last_raw){
+		s->t += s->period;
+		*t = s->t;
+		return 0;
+	}
+
+	delta = ptsdiff(raw, s->last_raw);
+	if (delta <= 0 || delta > RATE_JUMP){
+		s->t += s->period;
+	} else {
+		per = delta/s->since;
+		if (llabs(per - s->cand) <= RATE_PTS_TICK) s->period = per;
+		s->cand = per;
+		s->t = s->t_raw + delta;
+	}
+	s->last_raw = raw;
+	s->t_raw = s->t;
+	s->since = 0;
+	*t = s->t;
+	return 0;
+}
+
+static void queue_unit(rate_stream *s, int64_t t, uint32_t length)
+{
+	rate_au *u;
+
+	if (s->qhead + s->qlen == s->qsize){
+		if (s->qhead > s->qsize/2){
+			memmove(s->q, s->q + s->qhead, s->qlen*sizeof(rate_au));
+			s->vbv_next -= s->qhead;
+			s->qhead = 0;
+		} else {
+			s->qsize = s->qsize ? 2*s->qsize : 256;
+			if (!(s->q = realloc(s->q, s->qsize*sizeof(rate_au)))){
+				fprintf(stderr,"Not enough memory for rate profile\n");
+				exit(1);
+			}
+		}
+	}
+	u = &s->q[s->qhead + s->qlen++];
+	u->t = t;
+	u->left = length;
+}
+
+/* The pictures are queued with their number and put on the time line
+   with the frame rate, their time stamps are not reliable in analyze
+   mode. The VBV fills at the bit rate of the sequence header until it
+   is full (VBR), every picture is taken out at its decode time. */
+static void video_run(rate_stream *s)
+{
+	if (!limits) return;
+
+	for (; s->vbv_next < s->qhead + s->qlen; s->vbv_next++){
+		rate_au *u = &s->q[s->vbv_next];
+		rate_sec *sec;
+
+		u->t = s->t_raw + u->t*frame_period;
+		sec = sec_at(u->t);
+		sec->video += u->left;
+		frames++;
+		if (!bit_rate || !vbv_size) continue;
+
+		if (!vbv_started){
+			vbv = vbv_size;
+			vbv_started = 1;
+		} else if (u->t > vbv_t){
+			vbv += (u->t - vbv_t) * bit_rate / (8*RATE_SEC);
+			if (vbv > vbv_size) vbv = vbv_size;
+		}
+		vbv_t = u->t;
+		if (u->left > vbv){
+			sec->vbv_under++;
+			vbv_unders++;
+			vbv = 0;
+		} else vbv -= u->left;
+		if (vbv < sec->vbv_min) sec->vbv_min = vbv;
+	}
+}
+
+static inline uint64_t dtime(int64_t t)
+{
+	return t + RATE_BASE;
+}
+
+// decode time of a unit in the output
+static inline int64_t due(rate_stream *s, rate_au *u)
+{
+	return u->t + s->shift;
+}
+
+static void send_pack(rate_stream *s)
+{
+	uint32_t n = s->payload;
+	int64_t end = scr + scrinc;
+
+	while (n && s->qlen){
+		rate_au *u = &s->q[s->qhead];
+		uint32_t k = u->left < n ? u->left : n;
+		int64_t late = end - due(s, u);
+
+		dummy_add(&s->dbuf, dtime(due(s, u)), k);
+		u->left -= k;
+		n -= k;
+		if (u->left) break;
+
+		if (late > 0){
+			rate_sec *sec = sec_at(u->t);
+
+			sec->late++;
+			if (late > sec->late_max) sec->late_max = late;
+			if (late > late_max) late_max = late;
+			lates++;
+		}
+		s->qhead++;
+		s->qlen--;
+	}
+}
+
+/* Send one pack at a time to the stream with the earliest decode time
+   that has room for it in its STD buffer, audio before video, as
+   write_out_packs does.
+   Without all, it stops when a stream has nothing queued, which may
+   be the one to send next. */
+static void mux_run(int all)
+{
+	int i;
+
+	if (!limits || !scrinc) return;
+
+	if (!mux_started){
+		int64_t first = 0;
+		int have = 0;
+
+		// the video decides where the output starts
+		if (!all && !rs[0].used) return;
+
+		for (i = 0; i < RATE_STREAMS; i++){
+			rate_stream *s = &rs[i];
+
+			if (!s->used) continue;
+			if (!s->qlen){
+				if (!all) return;
+				continue;
+			}
+			if (!have || due(s, &s->q[s->qhead]) < first)
+				first = due(s, &s->q[s->qhead]);
+			have = 1;
+		}
+		if (!have) return;
+		scr = first - (int64_t)mx.video_delay;
+		mux_started = 1;
+	}
+
+	for (;;){
+		rate_stream *best = NULL;
+		int waiting = 0;
+
+		for (i = 0; i < RATE_STREAMS; i++){
+			rate_stream *s = &rs[i];
+			rate_au *u;
+
+			if (!s->used) continue;
+			if (!s->qlen){
+				if (!all) return;
+				continue;
+			}
+			waiting = 1;
+			dummy_delete(&s->dbuf, dtime(scr));
+			u = &s->q[s->qhead];
+			if (due(s, u) > scr + s->lead) continue;
+			if (dummy_space(&s->dbuf) < s->payload) continue;
+			if (!best || (best == &rs[0] && s != &rs[0]) ||
+			    due(s, u) < due(best, &best->q[best->qhead]))
+				best = s;
+		}
+		if (!waiting) return;
+		if (best) send_pack(best);
+		scr += scrinc;
+	}
+}
+
+void rate_init(void)
+{
+	int i;
+
+	for (i = 0; i < RATE_STREAMS; i++) free(rs[i].q);
+	memset(rs, 0, sizeof(rs));
+	free(secs);
+	secs = NULL;
+	nsecs = asecs = 0;
+	limits = origin_set = vbv_started = mux_started = 0;
+	frames = vframes = units = vbv_unders = lates = 0;
+	late_max = 0;
+	scrinc = 0;
+}
+
+void rate_limits(multiplex_t *m, sequence_t *seq)
+{
+	int i;
+
+	if (limits) return;
+	mx = *m;
+	need_rate = mx.muxr;
+	if (mx.mux_rate) mx.muxr = mx.mux_rate;
+	if (mx.muxr) scrinc = 27000000ULL*mx.pack_size/mx.muxr;
+	frame_period = CLOCK_PER/25000;
+	if (seq->set){
+		bit_rate = seq->bit_rate*400ULL;
+		vbv_size = seq->vbv_buffer_size*2048;
+		if (seq->frame_rate) frame_period = CLOCK_PER/seq->frame_rate;
+	}
+
+	for (i = 0; i < RATE_STREAMS; i++){
+		rate_stream *s = &rs[i];
+
+		if (!i){
+			s->payload = mx.vsize;
+			s->lead = mx.video_lead;
+			dummy_init(&s->dbuf, mx.video_buffer_size);
+		} else {
+			s->payload = mx.asize;
+			s->lead = mx.audio_lead;
+			dummy_init(&s->dbuf, mx.audio_buffer_size);
+			s->shift = (int64_t)mx.audio_delay -
+				(int64_t)mx.video_delay;
+		}
+	}
+	limits = 1;
+	video_run(&rs[0]);
+	mux_run(0);
+}
+
+void rate_unit(int kind, int n, index_unit *iu)
+{
+	rate_stream *s;
+	int64_t t;
+
+	switch (kind){
+	case AN_VIDEO:
+		s = &rs[0];
+		break;
+	case AN_MPA:
+		if (n >= N_AUDIO) return;
+		s = &rs[1+n];
+		break;
+	default:
+		if (n >= N_AC3) return;
+		s = &rs[1+N_AUDIO+n];
+		break;
+	}
+	if (kind == AN_VIDEO){
+		if (!s->used){
+			// the DTS is left out if it is the same as the PTS
+			uint64_t raw = iu->dts ? iu->dts : iu->pts;
+
+			if (!raw) return;
+			if (!origin_set){
+				origin = raw;
+				origin_set = 1;
+			}
+			s->used = 1;
+			s->t_raw = ptsdiff(raw, origin);
+		}
+		queue_unit(s, vframes++, iu->length);
+		video_run(s);
+	} else {
+		if (unit_time(s, iu->pts, &t) < 0) return;
+		queue_unit(s, t, iu->length);
+		sec_at(t)->audio += iu->length;
+	}
+	units++;
+	mux_run(0);
+}
+
+static const char *type_name(int otype)
+{
+	switch (otype){
+	case REPLEX_DVD:  return "DVD";
+	case REPLEX_HDTV: return "HDTV";
+	default:          return "MPEG2";
+	}
+}
+
+static double mbit(uint64_t bytes)
+{
+	return bytes*8/1000000.;
+}
+
+void rate_report(void)
+{
+	int i;
+	int over = 0;
+
+	mux_run(1);
+
+	printf("-t %s: mux rate %.2f Mbit/s", type_name(mx.otype),
+	       mbit(mx.muxr));
+	if (mx.mux_rate)
+		printf(", the streams need %.2f Mbit/s%s", mbit(need_rate),
+		       need_rate > mx.mux_rate ? ", too much" : "");
+	printf("\n");
+	printf("video %.2f Mbit/s, VBV %uK, STD buffers video %uK audio %uK\n",
+	       bit_rate/1000000., vbv_size/1024, mx.video_buffer_size/1024,
+	       mx.audio_buffer_size/1024);
+	printf("    time    video   audio     mux  VBV min\n");
+
+	for (i = 0; i < nsecs; i++){
+		rate_sec *s = &secs[i];
+		uint64_t mux = 0;
+
+		if (mx.data_size)
+			mux = (s->video + s->audio)*mx.pack_size/mx.data_size;
+		printf("%2d:%02d:%02d  %7.2f %7.2f %7.2f", i/3600, (i%3600)/60,
+		       i%60, mbit(s->video), mbit(s->audio), mbit(mux));
+		if (s->vbv_min == UINT32_MAX) printf("        -");
+		else printf("  %6uK", s->vbv_min/1024);
+		if (mx.mux_rate && mux > mx.mux_rate){
+			printf("  rate");
+			over++;
+		}
+		if (s->vbv_under) printf("  VBV underflow %d", s->vbv_under);
+		if (s->late)
+			printf("  late %d (%.1f ms)", s->late,
+			       s->late_max/(double)CLOCK_MS);
+		printf("\n");
+	}
+
+	if (mx.mux_rate)
+		printf("mux rate exceeded in %d of %d seconds\n", over, nsecs);
+	if (bit_rate && vbv_size && frames)
+		printf("VBV underflow at %llu of %llu frames\n",
+		       (unsigned long long)vbv_unders,
+		       (unsigned long long)frames);
+	printf("STD: %llu of %llu units late", (unsigned long long)lates,
+	       (unsigned long long)units);
+	if (lates) printf(", at most %.1f ms", late_max/(double)CLOCK_MS);
+	printf("\n");
+}
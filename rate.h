@@ -0,0 +1,46 @@
+/*
+ * rate.h
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef _RATE_H_
+#define _RATE_H_
+
+#include <stdint.h>
+#include "mpg_common.h"
+#include "multiplex.h"
+
+/* The bitrate profile of -Y rate. The units of every stream are put on
+   a time line without PTS jumps and counted per second. The video
+   units go through a VBV with the bit rate and buffer size of the
+   sequence header, all units through a simulated multiplexer which
+   sends packs at the mux rate into the STD buffers of the output type
+   (dummy_buffer, as in multiplex.c). */
+
+void rate_init(void);
+void rate_limits(multiplex_t *mx, sequence_t *seq);
+void rate_unit(int kind, int n, index_unit *iu);
+void rate_report(void);
+
+#endif /*_RATE_H_*/
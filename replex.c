@@ -37,11 +37,21 @@
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
 
 #include "replex.h"
 #include "pes.h"
+#include "stats.h"
+#include "fuzz.h"
+#include "analyze.h"
+#include "verify.h"
+#include "checkpoint.h"
+#include "rate.h"
 
 static int replex_all_set(struct replex *rx);
+static audio_stream_t *alloc_audio_streams(struct replex *rx, int type,
+					   uint16_t *ids, int n);
 
 void overflow_exit(struct replex *rx)
 {
@@ -80,11 +90,11 @@ static int audio_jump(struct replex *rx)
 	int i;
 
 	for (i=0; i<rx->apidn; i++)
-		if (rx->audio_jump[i])
+		if (rx->astream[i].jump)
 			return 1;
 
 	for (i=0; i<rx->ac3n; i++)
-		if (rx->ac3_jump[i])
+		if (rx->ac3stream[i].jump)
 			return 1;
 
 	return 0;
@@ -97,27 +107,43 @@ static int jump_finished(struct replex *rx)
 
 	if (!rx->video_jump) return 0;
 	for (i=0; i<rx->apidn; i++)
-		if (!rx->audio_jump[i])
+		if (!rx->astream[i].jump)
 			return 0;
 
 	for (i=0; i<rx->ac3n; i++)
-		if (!rx->ac3_jump[i])
+		if (!rx->ac3stream[i].jump)
 			return 0;
 
 	return 1;
 }
 
 
+/* Without --allow_jump a PTS jump is still repaired if it comes with a
+   discontinuity of the recovered input clock, i.e. less than
+   TS_PCR_MAX_GAP of input time after it. */
+#define CLOCK_JUMP (100*CLOCK_MS)
+static int clock_jump(struct replex *rx, int64_t diff)
+{
+	ts_clock_t *clk = &rx->clock;
+
+	if (rx->allow_jump || !clk->discons || 
+	    (diff <= (int64_t)CLOCK_JUMP && diff >= -(int64_t)CLOCK_JUMP))
+		return 0;
+	return ((clk->pcr + TS_PCR_WRAP - clk->discon_pcr) % TS_PCR_WRAP
+		< TS_PCR_MAX_GAP);
+}
+
+
 static void clear_jump(struct replex *rx)
 {
 	int i;
 
 	rx->video_jump = 0;
 	for (i=0; i<rx->apidn; i++)
-		rx->audio_jump[i] = 0;
+		rx->astream[i].jump = 0;
 
 	for (i=0; i<rx->ac3n; i++)
-		rx->ac3_jump[i] = 0;
+		rx->ac3stream[i].jump = 0;
 }
 
 
@@ -180,30 +206,30 @@ static void fill_in_frames(ringbuffer *index_buf, int fc, audio_frame_t *aframe,
 			fprintf(stderr,"audio ring buffer overrun error\n");
 			overflow_exit(rx);
 		}
+		stats_add(ST_AUDIO, 0, 1);
 		*acount += 1;
 	}
 }
 
-static int analyze_audio_loop( pes_in_t *p, struct replex *rx, int type, 
-			       audio_frame_t *aframe, index_unit *iu, 
-			       ringbuffer *rbuf, ringbuffer *index_buf,
-			       uint64_t *acount, uint64_t *fpts, 
-			       uint64_t *lpts, int bsize, int *apes_abort,
-			       uint64_t *ajump, uint64_t *aoff,
-			       uint64_t adelay, int n, int off,
-			       int c, int len, int pos, int *first, int *filled)
+static int analyze_audio_loop( pes_in_t *p, struct replex *rx, 
+			       audio_stream_t *as, int off,
+			       int c, int len, int pos, int *first)
 {
 	int re=0;
-	uint8_t *fillframe=NULL;
+	int type = as->type;
+	audio_frame_t *aframe = &as->frame;
+	index_unit *iu = &as->current_index;
+	ringbuffer *rbuf = &as->rbuffer;
+	ringbuffer *index_buf = &as->index_rbuffer;
+	uint64_t *acount = &as->frame_count;
+	uint64_t *fpts = &as->first_pts;
+	uint64_t *lpts = &as->last_pts;
+	int bsize = as->rbuffer.size;
+	int *apes_abort = &as->pes_abort;
+	uint64_t *ajump = &as->jump;
+	int *filled = &as->filled;
+	uint8_t *fillframe = as->fillframe;
 	
-	switch( type ){
-	case AC3:
-		fillframe = rx->ac3fillframe[n];
-		break;
-	case MPEG_AUDIO:
-		fillframe = rx->afillframe[n];
-		break;
-	}
 	if (!aframe->set){
 		switch( type ){
 		case AC3:
@@ -218,14 +244,16 @@ static int analyze_audio_loop( pes_in_t *p, struct replex *rx, int type,
 			break;
 		}
 		if ( re == -2){
-			*apes_abort = len -c;
+			*apes_abort = len -c-pos;
 			return c;
 		}
-		if (re < 0) return c;
+		/* not a usable header, step over the false sync */
+		if (re < 0) return c+pos+1;
 		
 		if (!rx->ignore_pts){
 			if ((p->flag2 & PTS_ONLY)){
 				*fpts = trans_pts_dts(p->pts);
+				as->clock = rx->clock.discons;
 				fprintf(stderr,
 					"starting audio PTS: ");
 				printpts(*fpts);
@@ -247,7 +275,7 @@ static int analyze_audio_loop( pes_in_t *p, struct replex *rx, int type,
 					     type)) < 0){
 			
 			if ( re == -2){
-				*apes_abort = len -c;
+				*apes_abort = len -c-pos;
 				return c;
 			}
 			
@@ -294,10 +322,12 @@ static int analyze_audio_loop( pes_in_t *p, struct replex *rx, int type,
 				*acount -= 1;
 			}
 			
+			if (rx->low_latency) iu->arrival = time_us();
 			if (ring_write(index_buf, (uint8_t *)iu, sizeof(index_unit)) < 0){
 				fprintf(stderr,"audio ring buffer overrun error\n");
 				overflow_exit(rx);
 			}
+			stats_add(ST_AUDIO, 0, 1);
 			if (iu->err == JUMP_ERR) *acount -= 1;
 			*acount += 1;
 		} 
@@ -311,11 +341,21 @@ static int analyze_audio_loop( pes_in_t *p, struct replex *rx, int type,
 			int64_t dpts;
 			int64_t diff;
 			
+			/* the time base changed before video started, so
+			   the first PTS isn't comparable to video anymore */
+			if (!rx->first_vpts && as->clock != rx->clock.discons){
+				*fpts = uptsdiff(trans_pts_dts(p->pts), iu->pts);
+				as->clock = rx->clock.discons;
+				fprintf(stderr,"new audio PTS after clock discontinuity: ");
+				printpts(*fpts);
+				fprintf(stderr,"\n");
+			}
+
 			dpts = ptsdiff(trans_pts_dts(p->pts), *fpts);
 			diff = ptsdiff(dpts, iu->pts);
 			
-			if (rx->allow_jump &&
-			    (int)diff > rx->allow_jump){
+			if ((rx->allow_jump && (int)diff > rx->allow_jump) ||
+			    clock_jump(rx, diff)){
 				
 				if (!(*ajump) && rx->video_jump){
 					int fc=0;
@@ -487,85 +527,40 @@ static int analyze_audio_loop( pes_in_t *p, struct replex *rx, int type,
 
 
 
-void analyze_audio( pes_in_t *p, struct replex *rx, int len, int num, int type)
+void analyze_audio( pes_in_t *p, struct replex *rx, int len, 
+		    audio_stream_t *as)
 {
 	int c=0;
 	int pos=0;
-	audio_frame_t *aframe = NULL;
-	index_unit *iu = NULL;
-	ringbuffer *rbuf = NULL, *index_buf = NULL;
-	uint64_t *acount=NULL;
-	uint64_t *fpts=NULL;
-	uint64_t *lpts=NULL;
-	int bsize = 0;
-	uint64_t *ajump=NULL;
-	uint64_t *aoff=NULL;
 	uint8_t buf[7];
 	int off=0;
-	int *apes_abort=NULL;
-	uint64_t adelay=0;
 	int first = 1;
-	int *filled=NULL;
+	int st = stats_enter(ST_AUDIO);
 	
-	switch ( type ){
-	case AC3:
-#ifdef IN_DEBUG
-		fprintf(stderr, "AC3\n");
-#endif
-		aframe = &rx->ac3frame[num];	
-		iu = &rx->current_ac3index[num];
-		rbuf = &rx->ac3rbuffer[num];
-		index_buf = &rx->index_ac3rbuffer[num];
-		acount = &rx->ac3frame_count[num];
-		fpts = &rx->first_ac3pts[num];
-		lpts = &rx->last_ac3pts[num];
-		bsize = rx->ac3buf;
-		apes_abort = &rx->ac3pes_abort[num];
-		ajump = &rx->ac3_jump[num];
-		aoff = &rx->ac3pts_off[num];
-		adelay = rx->ac3pts_off[num];
-		filled = &rx->ac3filled[num];
-		break;
-
-	case MPEG_AUDIO:
 #ifdef IN_DEBUG
-		fprintf(stderr, "MPEG AUDIO\n");
+	fprintf(stderr, as->type == AC3 ? "AC3\n" : "MPEG AUDIO\n");
 #endif
-		aframe = &rx->aframe[num];	
-		iu = &rx->current_aindex[num];
-		rbuf = &rx->arbuffer[num];
-		index_buf = &rx->index_arbuffer[num];
-		acount = &rx->aframe_count[num];
-		fpts = &rx->first_apts[num];
-		lpts = &rx->last_apts[num];
-		bsize = rx->audiobuf;
-		apes_abort = &rx->apes_abort[num];
-		ajump = &rx->audio_jump[num];
-		aoff = &rx->apts_off[num];
-		adelay = rx->apts_off[num];
-	        filled = &rx->afilled[num];
-		break;
-	}
-	
-	*apes_abort = 0;
-	off = ring_rdiff(rbuf, p->ini_pos);
+	as->pes_abort = 0;
+	off = ring_rdiff(&as->rbuffer, p->ini_pos);
 	while (c < len){
-		if ( (pos = find_audio_sync(rbuf, buf, c+off, type, len-c) ) 
-		     >= 0 ){
-			c = analyze_audio_loop( p, rx, type, aframe, iu, 
-						rbuf, index_buf, acount, fpts, 
-						lpts, bsize, apes_abort,
-						ajump, aoff, adelay, num, off,
-						c, len, pos, &first, filled);
+		FUZZ_WORK(1);
+		if ( (pos = find_audio_sync(&as->rbuffer, buf, c+off, 
+					    as->type, len-c) ) >= 0 ){
+			c = analyze_audio_loop( p, rx, as, off, c, len, pos, 
+						&first);
 		} else {
-			*apes_abort = len-c;
+			/* only a sync byte at the very end is worth
+			   looking at again with the next packet */
+			as->pes_abort = pos == -2 ? 1 : 0;
 			c=len;
 		}
 	}	
+	stats_add(ST_AUDIO, len, 0);
+	stats_leave(st);
 }
 
 
-void analyze_video( pes_in_t *p, struct replex *rx, int len)
+static void analyze_video_pes( pes_in_t *p, struct replex *rx, int len)
 {
 	uint8_t buf[8];
 	int c=0;
@@ -606,7 +601,9 @@ void analyze_video( pes_in_t *p, struct replex *rx, int len)
 	
 //	fprintf(stderr, "len %d  %d\n",len,off);
 	while (c < len){
-		if ((pos = ring_find_any_header( rbuf, &head, c+off, len-c)) 
+		FUZZ_WORK(1);
+		if ((pos = ring_find_nonslice_header( rbuf, &head, c+off, 
+						      len-c)) 
 		    >=0 ){
 			switch(head){
 			case SEQUENCE_HDR_CODE:
@@ -697,8 +694,9 @@ void analyze_video( pes_in_t *p, struct replex *rx, int len)
 							       rx->first_vpts 
 							       + newpts);
 						
-						if (rx->allow_jump &&  
-						    abs(diff) > rx->allow_jump)
+						if ((rx->allow_jump &&  
+						     abs(diff) > rx->allow_jump) ||
+						    clock_jump(rx, diff))
 						{
 							if (audio_jump(rx)){
 								fprintf(stderr,"AUDIO JUMPED\n");
@@ -916,6 +914,8 @@ void analyze_video( pes_in_t *p, struct replex *rx, int len)
 								  iu->start, 
 								  p->ini_pos+
 								  pos+c-frame_off);
+					if (rx->low_latency)
+						iu->arrival = time_us();
 
 					if ( ring_write(index_buf, (uint8_t *)
 							 &rx->current_vindex,
@@ -924,6 +924,7 @@ void analyze_video( pes_in_t *p, struct replex *rx, int len)
 						overflow_exit(rx);
 
 					}
+					stats_add(ST_VIDEO, 0, 1);
 				} 
 				init_index(&rx->current_vindex);
 				flush = 0;
@@ -968,6 +969,15 @@ void analyze_video( pes_in_t *p, struct replex *rx, int len)
 	}
 }
 
+void analyze_video( pes_in_t *p, struct replex *rx, int len)
+{
+	int st = stats_enter(ST_VIDEO);
+
+	analyze_video_pes(p, rx, len);
+	stats_add(ST_VIDEO, len, 0);
+	stats_leave(st);
+}
+
 void es_out(pes_in_t *p)
 {
 
@@ -978,50 +988,56 @@ void es_out(pes_in_t *p)
 	len = p->plength-3-p->hlength;
 
 	rx = (struct replex *) p->priv;
+	stats_add(ST_PES, 0, 1);
 
 	switch(p->type)
 	{
 	case 0xE0: {
 		sprintf(t, "Video ");
 		if (rx->vpes_abort){
-			p->ini_pos = (p->ini_pos - rx->vpes_abort)%rx->vrbuffer.size;
+			p->ini_pos = (p->ini_pos - rx->vpes_abort 
+				      + rx->vrbuffer.size)%rx->vrbuffer.size;
 			len += rx->vpes_abort;
 		}
 		analyze_video(p, rx, len);
 		if (!rx->seq_head.set){
-			ring_skip(&rx->vrbuffer, len);
+			ring_skip(&rx->vrbuffer, len - rx->vpes_abort);
 		}
 		break;
 	}
 
 	case 1 ... 32:{
 		int l;
+		audio_stream_t *as;
 		l = p->type - 1;
+		as = &rx->astream[l];
 		sprintf(t, "Audio%d ", l);
-		if (rx->apes_abort[l]){
-			p->ini_pos = (p->ini_pos - rx->apes_abort[l])
-			  %rx->arbuffer[l].size;
-			len += rx->apes_abort[l];
-		}
-		analyze_audio(p, rx, len, l, MPEG_AUDIO);
-		if (!rx->aframe[l].set)
-			ring_skip(&rx->arbuffer[l], len);
+		if (as->pes_abort){
+			p->ini_pos = (p->ini_pos - as->pes_abort
+				      + as->rbuffer.size)%as->rbuffer.size;
+			len += as->pes_abort;
+		}
+		analyze_audio(p, rx, len, as);
+		if (!as->frame.set)
+			ring_skip(&as->rbuffer, len - as->pes_abort);
 		
 		break;
 	}
 
 	case 0x80 ... 0x87:{
 		int l;
+		audio_stream_t *as;
 		l = p->type - 0x80;
+		as = &rx->ac3stream[l];
 		sprintf(t, "AC3 %d ", p->type);
-		if (rx->ac3pes_abort[l]){
-			p->ini_pos = (p->ini_pos - rx->ac3pes_abort[l])
-				%rx->ac3rbuffer[l].size;
-			len += rx->ac3pes_abort[l];
-		}
-		analyze_audio(p, rx, len, l, AC3);
-		if (!rx->ac3frame[l].set)
-			ring_skip(&rx->ac3rbuffer[l], len);
+		if (as->pes_abort){
+			p->ini_pos = (p->ini_pos - as->pes_abort
+				      + as->rbuffer.size)%as->rbuffer.size;
+			len += as->pes_abort;
+		}
+		analyze_audio(p, rx, len, as);
+		if (!as->frame.set)
+			ring_skip(&as->rbuffer, len - as->pes_abort);
 		break;
 	}
 
@@ -1040,10 +1056,13 @@ void pes_es_out(pes_in_t *p)
 {
 
 	struct replex *rx = NULL;
+	audio_stream_t *as;
 	char t[80];
 	int len = 0, i =0;
 	int l=0;
 
+	stats_add(ST_PES, 0, 1);
+
 	len = p->plength-3-p->hlength;
 	rx = (struct replex *) p->priv;
 
@@ -1058,13 +1077,14 @@ void pes_es_out(pes_in_t *p)
 			overflow_exit(rx);
 		}
 		if (rx->vpes_abort){
-			p->ini_pos = (p->ini_pos - rx->vpes_abort)%rx->vrbuffer.size;
+			p->ini_pos = (p->ini_pos - rx->vpes_abort 
+				      + rx->vrbuffer.size)%rx->vrbuffer.size;
 			len += rx->vpes_abort;
 		}
 		sprintf(t, "Video ");
 		analyze_video(p, rx, len);
 		if (!rx->seq_head.set){
-			ring_skip(&rx->vrbuffer, len);
+			ring_skip(&rx->vrbuffer, len - rx->vpes_abort);
 		}
 		break;
 		
@@ -1075,21 +1095,22 @@ void pes_es_out(pes_in_t *p)
 			if (p->cid == rx->apid[i])
 				l = i;
 		if (l < 0) break;
-		p->ini_pos = ring_wpos(&rx->arbuffer[l]);
-		if (ring_write(&rx->arbuffer[l], p->buf+9+p->hlength, len)<0){
+		as = &rx->astream[l];
+		p->ini_pos = ring_wpos(&as->rbuffer);
+		if (ring_write(&as->rbuffer, p->buf+9+p->hlength, len)<0){
 			fprintf(stderr,"audio ring buffer overrun error\n");
 			overflow_exit(rx);
 		}
-		if (rx->apes_abort[l]){
-			p->ini_pos = (p->ini_pos - rx->apes_abort[l])
-			  %rx->arbuffer[l].size;
-			len += rx->apes_abort[l];
+		if (as->pes_abort){
+			p->ini_pos = (p->ini_pos - as->pes_abort
+				      + as->rbuffer.size)%as->rbuffer.size;
+			len += as->pes_abort;
 		}
 
 		sprintf(t, "Audio%d ", l);
-		analyze_audio(p, rx, len, l, MPEG_AUDIO);
-		if (!rx->aframe[l].set)
-			ring_skip(&rx->arbuffer[l], len);
+		analyze_audio(p, rx, len, as);
+		if (!as->frame.set)
+			ring_skip(&as->rbuffer, len - as->pes_abort);
 		
 		break;
 		
@@ -1116,23 +1137,24 @@ void pes_es_out(pes_in_t *p)
 			if (l < 0) break;
 		}
 		len -= hl;
-		p->ini_pos = ring_wpos(&rx->ac3rbuffer[l]);
+		as = &rx->ac3stream[l];
+		p->ini_pos = ring_wpos(&as->rbuffer);
 	
-		if (ring_write(&rx->ac3rbuffer[l], p->buf+9+hl+p->hlength, len)<0){
+		if (ring_write(&as->rbuffer, p->buf+9+hl+p->hlength, len)<0){
 			fprintf(stderr,"ac3 ring buffer overrun error\n");
 			overflow_exit(rx);
 		}
-		if (rx->ac3pes_abort[l]){
-			p->ini_pos = (p->ini_pos - rx->ac3pes_abort[l])
-				%rx->ac3rbuffer[l].size;
-			len += rx->ac3pes_abort[l];
+		if (as->pes_abort){
+			p->ini_pos = (p->ini_pos - as->pes_abort
+				      + as->rbuffer.size)%as->rbuffer.size;
+			len += as->pes_abort;
 		}
 
 		sprintf(t, "AC3 %d ", p->type);
-		analyze_audio(p, rx, len, l, AC3);
-		sprintf(t,"%d",rx->ac3frame[l].set);
-		if (!rx->ac3frame[l].set)
-			ring_skip(&rx->ac3rbuffer[l], len);
+		analyze_audio(p, rx, len, as);
+		sprintf(t,"%d",as->frame.set);
+		if (!as->frame.set)
+			ring_skip(&as->rbuffer, len - as->pes_abort);
 	}
 		break;
 		
@@ -1152,6 +1174,7 @@ void avi_es_out(pes_in_t *p)
 	char t[80];
 	int len;
 
+	stats_add(ST_PES, 0, 1);
 	len = p->plength;
 
 	rx = (struct replex *) p->priv;
@@ -1177,12 +1200,12 @@ void avi_es_out(pes_in_t *p)
 		l = p->type - 1;
 		sprintf(t, "Audio%d ", l);
 		if (!len){
-			rx->aframe_count[l]++;
+			rx->astream[l].frame_count++;
 			break;
 		}
-		analyze_audio(p, rx, len, l, MPEG_AUDIO);
-		if (!rx->aframe[l].set)
-			ring_skip(&rx->arbuffer[l], len);
+		analyze_audio(p, rx, len, &rx->astream[l]);
+		if (!rx->astream[l].frame.set)
+			ring_skip(&rx->astream[l].rbuffer, len);
 		
 		break;
 	}
@@ -1193,12 +1216,12 @@ void avi_es_out(pes_in_t *p)
 		l = p->type - 0x80;
 		sprintf(t, "AC3 %d ", p->type);
 		if (!len){
-			rx->ac3frame_count[l]++;
+			rx->ac3stream[l].frame_count++;
 			break;
 		}
-		analyze_audio(p, rx, len, l, AC3);
-		if (!rx->ac3frame[l].set)
-			ring_skip(&rx->ac3rbuffer[l], len);
+		analyze_audio(p, rx, len, &rx->ac3stream[l]);
+		if (!rx->ac3stream[l].frame.set)
+			ring_skip(&rx->ac3stream[l].rbuffer, len);
 		break;
 	}
 
@@ -1214,72 +1237,221 @@ void avi_es_out(pes_in_t *p)
 }
 
 
-int replex_tsp(struct replex *rx, uint8_t *tsp)
+#define IN_SIZE (1000*TS_SIZE)
+#define LL_IN_SIZE (32*TS_SIZE)
+#define LL_VIDEO_BUF (1024*1024)
+static pes_in_t *replex_pes(struct replex *rx, uint16_t pid, ts_pid_t **ts,
+			    index_unit **iu)
 {
-	uint16_t pid;
+	audio_stream_t *as;
 	int type;
-	int off=0;
-	pes_in_t *p=NULL;
-
-	pid = get_pid(tsp+1);
 
 	if ((type=replex_check_id(rx, pid))<0)
-		return 0;
+		return NULL;
 	
 	switch(type){
 	case 0:
-		p = &rx->pvideo;
-		break;
+		*ts = &rx->vts;
+		*iu = &rx->current_vindex;
+		return &rx->pvideo;
 
 	case 1 ... 32:
-		p = &rx->paudio[type-1];
+		as = &rx->astream[type-1];
 		break;
 
 	case 0x80 ... 0x87:
-		p = &rx->pac3[type-0x80];
+		as = &rx->ac3stream[type-0x80];
 		break;
+
 	default:
+		return NULL;
+	}
+	*ts = &as->ts;
+	*iu = &as->current_index;
+	return &as->pes;
+}
+
+/* Packets continuing a PES packet that does not end in them are
+   appended straight to the stream ring, for the whole run of such
+   packets of one PID in buf. Returns the number of packets used. */
+static int replex_ts_cont(struct replex *rx, uint8_t *buf, int n)
+{
+	struct iovec iov[IN_SIZE/TS_SIZE];
+	uint16_t pid;
+	pes_in_t *p;
+	ts_pid_t *ts;
+	index_unit *iu;
+	int room, len=0;
+	int k;
+
+	if (buf[1] & PAY_START) return 0;
+	pid = get_pid(buf+1);
+	if (!(p = replex_pes(rx, pid, &ts, &iu)) || ts->lost ||
+	    !(room = pes_payload_room(p)))
 		return 0;
-		
+
+	if (n > IN_SIZE/TS_SIZE) n = IN_SIZE/TS_SIZE;
+	for (k=0; k < n; k++){
+		uint8_t *tsp = buf+k*rx->ts_stride;
+		int off = 0;
+
+		if ((tsp[1] & PAY_START) || get_pid(tsp+1) != pid ||
+		    ts_continuity(ts, tsp) != TS_CC_OK) break;
+		if ( tsp[3] & ADAPT_FIELD){
+			if (tsp[4] && (tsp[5] & PCR_FLAG)) break;
+			off = tsp[4] + 1;
+			if (off+4 >= TS_SIZE) off = TS_SIZE-4;
+		}
+		if (len + TS_SIZE-4-off > room) break;
+		ts_count_packet(ts, tsp);
+		iov[k].iov_base = tsp+4+off;
+		iov[k].iov_len = TS_SIZE-4-off;
+		len += TS_SIZE-4-off;
+	}
+	if (!k) return 0;
+
+	if (ring_writev(p->rbuf, iov, k) < 0){
+		fprintf(stderr, "ring buffer overflow in get_pes %d\n"
+			,p->rbuf->size);
+		exit(1);
+	}
+	p->found += len;
+
+	return k;
+}
+
+/* The clock follows the first of our PIDs that carries PCRs. This is
+   done after the PES before the PCR packet has been passed on, so that
+   its frames are still judged by the old time base. */
+static void replex_pcr(struct replex *rx, uint8_t *tsp)
+{
+	ts_clock_t *clk = &rx->clock;
+
+	if (clk->set && get_pid(tsp+1) != clk->pid) return;
+	if (ts_clock_update(clk, tsp) == TS_PCR_DISCON){
+		fprintf(stderr,"clock discontinuity on PID 0x%04x at PCR ",
+			clk->pid);
+		printpts(clk->pcr);
+		fprintf(stderr,"\n");
+	}
+}
+
+int replex_tsp(struct replex *rx, uint8_t *tsp)
+{
+	uint16_t pid;
+	int off=0;
+	pes_in_t *p=NULL;
+	ts_pid_t *ts;
+	index_unit *iu;
+	int st;
+
+	pid = get_pid(tsp+1);
+
+	if (!(p = replex_pes(rx, pid, &ts, &iu)))
+		return 0;
+
+	switch (ts_count_packet(ts, tsp)){
+	case TS_CC_OK:
+		break;
+	case TS_CC_DUP:
+		return 0;
+	default:
+		if (!ts->lost && iu->active) iu->err = FRAME_ERR;
+		ts->lost = 1;
+		break;
 	}
 
+	/* a damaged packet is dropped, the PES packet that got hit is
+	   passed on as far as it came at the next unit start */
+	if (tsp[1] & TRANS_ERROR)
+		return 0;
 	
 	if ( tsp[1] & PAY_START){
-		if (p->plength == MMAX_PLENGTH-6){
+		if (p->plength == MMAX_PLENGTH-6 || 
+		    (ts->lost && pes_payload_room(p))){
 			p->plength = p->found-6;
 			es_out(p);
 			init_pes_in(p, p->type, NULL, 0);
-		}
+		} else if (ts->lost)
+			init_pes_in(p, p->type, NULL, 0);
+		ts->lost = 0;
 	}
 
 	if ( tsp[3] & ADAPT_FIELD){  // adaptation field?
+		if (tsp[4] && (tsp[5] & PCR_FLAG)) replex_pcr(rx, tsp);
 		off = tsp[4] + 1;
 		if (off+4 >= TS_SIZE) return 0;
 	}
         
+	st = stats_enter(ST_PES);
 	get_pes(p, tsp+4+off, TS_SIZE-4-off, es_out);
+	stats_add(ST_PES, TS_SIZE-4-off, 0);
+	stats_leave(st);
 	
 	return 0;
 }
 
 
+/* Wait until the followed input file grows. Returns 0 at the end of
+   the recording, i.e. when the writer has closed the file or no new
+   data arrived for rx->follow seconds. */
+static int follow_wait(struct replex *rx)
+{
+	char ev[4096];
+	struct stat st;
+	struct pollfd pfd;
+	off_t pos;
+	int i, re;
+
+	if (!rx->follow || (rx->inputFiles && rx->inputFiles[rx->inputIdx+1])) 
+		return 0;
+
+	while (1){
+		if (fstat(rx->fd_in, &st) < 0) return 0;
+		if ((pos = lseek(rx->fd_in, 0, SEEK_CUR)) < 0) return 0;
+		if (st.st_size > pos){
+			rx->inflength = st.st_size;
+			return 1;
+		}
+		if (rx->follow_closed) return 0;
+
+		pfd.fd = rx->follow_fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, rx->follow*1000) <= 0){
+			fprintf(stderr,"\nno new input for %d s\n", rx->follow);
+			rx->follow_closed = 1;
+			return 0;
+		}
+		if ((re = read(rx->follow_fd, ev, sizeof(ev))) <= 0) return 0;
+		for (i=0; i < re; 
+		     i += sizeof(struct inotify_event)+
+			     ((struct inotify_event *)(ev+i))->len)
+			if (((struct inotify_event *)(ev+i))->mask 
+			    & IN_CLOSE_WRITE)
+				rx->follow_closed = 1;
+	}
+}
+
 ssize_t save_read(struct replex *rx, void *buf, size_t count)
 {
 	ssize_t neof = 1;
 	size_t re = 0;
 	int fd = rx->fd_in;
+	int st;
 
 	if (rx->itype== REPLEX_AVI){
 		int l = rx->inflength - rx->finread;
 		if ( l <= 0) return 0;
 		if ( count > l) count = l;
 	}
+	st = stats_enter(ST_READ);
 	while(neof >= 0 && re < count){
 		neof = read(fd, buf+re, count - re);
 		if (neof > 0) re += neof;
-		else break;
+		else if (neof || !follow_wait(rx)) break;
 	}
 	rx->finread += re;
+	ring_clock += re;
 #ifndef OUT_DEBUG
 	if (rx->inflength){
 		uint8_t per=0;
@@ -1305,6 +1477,8 @@ ssize_t save_read(struct replex *rx, void *buf, size_t count)
 		}
 	} else fprintf(stderr,"read %.2f MB\r", rx->finread/1024./1024.);
 #endif
+	stats_add(ST_READ, re, 1);
+	stats_leave(st);
 	if (neof < 0 && re == 0) return neof;
 	else return re;
 }
@@ -1324,17 +1498,21 @@ int guess_fill( struct replex *rx)
 		fill = ring_free(&rx->vrbuffer);
 	
 	for (i=0; i<rx->apidn;i++){
-		if ((aavail = ring_avail(&rx->index_arbuffer[i])
+		audio_stream_t *as = &rx->astream[i];
+
+		if ((aavail = ring_avail(&as->index_rbuffer)
 		     /sizeof(index_unit)) < LIMIT)
-			if (fill < ring_free(&rx->arbuffer[i]))
-				fill = ring_free(&rx->arbuffer[i]);
+			if (fill < ring_free(&as->rbuffer))
+				fill = ring_free(&as->rbuffer);
 	}
 
 	for (i=0; i<rx->ac3n;i++){
-		if ((ac3avail = ring_avail(&rx->index_ac3rbuffer[i])
+		audio_stream_t *as = &rx->ac3stream[i];
+
+		if ((ac3avail = ring_avail(&as->index_rbuffer)
 		     /sizeof(index_unit)) < LIMIT)
-			if (fill < ring_free(&rx->ac3rbuffer[i]))
-				fill = ring_free(&rx->ac3rbuffer[i]);
+			if (fill < ring_free(&as->rbuffer))
+				fill = ring_free(&as->rbuffer);
 	}
 
 //	fprintf(stderr,"free %d  %d %d %d\n",fill, vavail, aavail, ac3avail);
@@ -1347,9 +1525,36 @@ int guess_fill( struct replex *rx)
 	return fill/2;
 }
 
+/* With several programs on one input a read is demultiplexed into all
+   of them, so it has to fit into the rings of the others too. At least
+   one packet is read, so that the program asking does not stall. */
+static int shared_fill(struct replex *rx, int fill)
+{
+	struct replex *s;
+	int i;
+
+	if (fill <= 0 || (!rx->in && !rx->next)) return fill;
+	for (s = rx->in ? rx->in : rx; s; s = s->next){
+		int f, room;
+
+		if (s == rx) continue;
+		room = ring_free(&s->vrbuffer);
+		for (i=0; i < s->apidn; i++)
+			if (ring_free(&s->astream[i].rbuffer) < room)
+				room = ring_free(&s->astream[i].rbuffer);
+		for (i=0; i < s->ac3n; i++)
+			if (ring_free(&s->ac3stream[i].rbuffer) < room)
+				room = ring_free(&s->ac3stream[i].rbuffer);
+		room /= 2;
+		if ((f = guess_fill(s)) <= 0 || f > room) f = room;
+		if (f < fill) fill = f;
+	}
+	if (fill < TS_MAX_SIZE) fill = TS_MAX_SIZE;
+	return fill;
+}
+
 
 
-#define IN_SIZE (1000*TS_SIZE)
 void find_pids_file(struct replex *rx)
 {
 	uint8_t buf[IN_SIZE];
@@ -1358,16 +1563,20 @@ void find_pids_file(struct replex *rx)
 	int count=0;
 	int re=0;
 	uint16_t vpid=0, apid=0, ac3pid=0;
+	uint64_t finread = rx->finread;
+	off_t pos = lseek(rx->fd_in, 0, SEEK_CUR);
 	
 	fprintf(stderr,"Trying to find PIDs\n");
-	while (!afound && !vfound && count < rx->inflength){
+	while (!afound && !vfound && (count < rx->inflength || rx->follow)){
 		if (rx->vpid) vfound = 1;
 		if (rx->apidn) afound = 1;
-		if ((re = save_read(rx,buf,IN_SIZE))<0)
+		if ((re = save_read(rx,buf,IN_SIZE-IN_SIZE%rx->ts_stride))<0)
 			perror("reading");
+		else if (!re) break;
 		else
 			count += re;
-		if ( (re = find_pids(&vpid, &apid, &ac3pid, buf, re))){
+		if ( (re = find_pids(&vpid, &apid, &ac3pid, buf, re, 
+				     rx->ts_stride))){
 			if (!rx->vpid && vpid){
 				rx->vpid = vpid;
 				fprintf(stderr,"vpid 0x%04x  \n",
@@ -1393,7 +1602,8 @@ void find_pids_file(struct replex *rx)
 		
 	}
 	
-	lseek(rx->fd_in,0,SEEK_SET);
+	lseek(rx->fd_in, pos, SEEK_SET);
+	rx->finread = finread;
 	if (!afound || !vfound){
 		fprintf(stderr,"Couldn't find all pids\n");
 		exit(1);
@@ -1421,11 +1631,11 @@ void find_all_pids_file(struct replex *rx)
 	
 	fprintf(stderr,"Trying to find PIDs\n");
 	while (count < rx->inflength-IN_SIZE){
-		if ((re = save_read(rx,buf,IN_SIZE))<0)
+		if ((re = save_read(rx,buf,IN_SIZE-IN_SIZE%rx->ts_stride))<0)
 			perror("reading");
 		else
 			count += re;
-		if ( (re = find_pids_pos(&vp, &ap, &cp, buf, re,
+		if ( (re = find_pids_pos(&vp, &ap, &cp, buf, re, rx->ts_stride,
 					 &vpos, &apos, &cpos))){
 			if (vp){
 				int old=0;
@@ -1496,7 +1706,7 @@ void find_pids_stdin(struct replex *rx, uint8_t *buf, int len)
 	if (rx->vpid) vfound = 1;
 	if (rx->apidn) afound = 1;
 	fprintf(stderr,"Trying to find PIDs\n");
-	if ( find_pids(&vpid, &apid, &ac3pid, buf, len) ){
+	if ( find_pids(&vpid, &apid, &ac3pid, buf, len, rx->ts_stride) ){
 		if (!rx->vpid && vpid){
 			rx->vpid = vpid;
 			vfound++;
@@ -1505,28 +1715,16 @@ void find_pids_stdin(struct replex *rx, uint8_t *buf, int len)
 			rx->apid[0] = apid;
 			rx->apidn++;
 			afound++;
-			ring_init(&rx->arbuffer[0], rx->audiobuf);
-			init_pes_in(&rx->paudio[0], 1, &rx->arbuffer[0], 0);
-			rx->paudio[0].priv = (void *) rx;
-			ring_init(&rx->index_arbuffer[0], INDEX_BUF);
-			memset(&rx->aframe[0], 0, sizeof(audio_frame_t));
-			init_index(&rx->current_aindex[0]);
-			rx->aframe_count[0] = 0;
-			rx->first_apts[0] = 0;
+			rx->astream = alloc_audio_streams(rx, MPEG_AUDIO, 
+							  rx->apid, 1);
 		}
 		
 		if (!rx->ac3n && ac3pid){
 			rx->ac3_id[0] = ac3pid;
 			rx->ac3n++;
 			afound++;
-			ring_init(&rx->ac3rbuffer[0], rx->ac3buf);
-			init_pes_in(&rx->pac3[0], 0x80, &rx->ac3rbuffer[0],0);
-			rx->pac3[0].priv = (void *) rx;
-			ring_init(&rx->index_ac3rbuffer[0], INDEX_BUF);
-			memset(&rx->ac3frame[0], 0, sizeof(audio_frame_t));
-			init_index(&rx->current_ac3index[0]);
-			rx->ac3frame_count[0] = 0;
-			rx->first_ac3pts[0] = 0;
+			rx->ac3stream = alloc_audio_streams(rx, AC3, 
+							    rx->ac3_id, 1);
 		}
 		
 	}
@@ -1606,7 +1804,7 @@ void pes_id_out(pes_in_t *p)
 		p->cid = 0;
 		p->type = 0;
 		rx->scan_found=0;
-		memset(p->buf,0,MAX_PLENGTH*sizeof(uint8_t));
+		memset(p->buf,0,PES_BUF_SIZE*sizeof(uint8_t));
 		return;
 	}
 }
@@ -1713,45 +1911,263 @@ void find_pes_ids(struct replex *rx)
 
 
 
+static void ts_loss_line(char *name, uint16_t pid, ts_pid_t *ts)
+{
+	if (!ts->cc_errors && !ts->trans_errors) return;
+	fprintf(stderr,"%s PID 0x%04x: %lld packets, %d continuity errors, %d transport errors\n",
+		name, pid, (long long)ts->packets, ts->cc_errors, 
+		ts->trans_errors);
+}
+
+static void ts_loss_report(struct replex *rx)
+{
+	char name[20];
+	int i;
+
+	ts_loss_line("video ", rx->vpid, &rx->vts);
+	for (i=0; i < rx->apidn; i++){
+		sprintf(name, "audio%d", i);
+		ts_loss_line(name, rx->apid[i], &rx->astream[i].ts);
+	}
+	for (i=0; i < rx->ac3n; i++){
+		sprintf(name, "ac3%d  ", i);
+		ts_loss_line(name, rx->ac3_id[i], &rx->ac3stream[i].ts);
+	}
+}
+
+static void ring_line(char *name, int size, int high, int avg)
+{
+	fprintf(stderr,"%-12s %8d KB  max %8d KB %3d%%  average %3d%%\n",
+		name, size/1024, high/1024, (int)((uint64_t)high*100/size),
+		(int)((uint64_t)avg*100/size));
+}
+
+// size of -g in MB that would have held high in a ring of size rsize
+static int needed_buf(struct replex *rx, int rsize, int high)
+{
+	uint64_t need = (uint64_t)high*5/4*rx->bufsize/rsize;
+
+	return (need + 1024*1024-1)/(1024*1024);
+}
+
+static void buffer_report(struct replex *rx)
+{
+	multiplex_t *mx = rx->demux ? NULL : (multiplex_t *)rx->priv;
+	char name[20];
+	int g = 1;
+	int i, n;
+
+	if (stats_on){
+		ring_line("video", rx->vrbuffer.size, rx->vrbuffer.high,
+			  ring_avg_fill(&rx->vrbuffer));
+		ring_line("video index", rx->index_vrbuffer.size, 
+			  rx->index_vrbuffer.high,
+			  ring_avg_fill(&rx->index_vrbuffer));
+		if (mx)
+			ring_line("video STD", mx->vdbuf.size, mx->vdbuf.high,
+				  dummy_avg_fill(&mx->vdbuf));
+	}
+	if ((n = needed_buf(rx, rx->vrbuffer.size, rx->vrbuffer.high)) > g)
+		g = n;
+
+	for (i=0; i < rx->apidn + rx->ac3n; i++){
+		audio_stream_t *as;
+
+		if (i < rx->apidn){
+			as = &rx->astream[i];
+			sprintf(name, "audio%d", i);
+		} else {
+			as = &rx->ac3stream[i-rx->apidn];
+			sprintf(name, "ac3%d", i-rx->apidn);
+		}
+		if (stats_on){
+			ring_line(name, as->rbuffer.size, as->rbuffer.high, 
+				  ring_avg_fill(&as->rbuffer));
+			strcat(name, " index");
+			ring_line(name, as->index_rbuffer.size, 
+				  as->index_rbuffer.high,
+				  ring_avg_fill(&as->index_rbuffer));
+			if (mx){
+				name[strlen(name)-6] = 0;
+				strcat(name, " STD");
+				ring_line(name, as->dbuf.size, as->dbuf.high,
+					  dummy_avg_fill(&as->dbuf));
+			}
+		}
+		if ((n = needed_buf(rx, as->rbuffer.size, 
+				    as->rbuffer.high)) > g)
+			g = n;
+	}
+
+	fprintf(stderr,"buffers: video max %d%%", 
+		(int)((uint64_t)rx->vrbuffer.high*100/rx->vrbuffer.size));
+	for (i=0; i < rx->apidn; i++)
+		fprintf(stderr,", audio%d max %d%%", i, 
+			(int)((uint64_t)rx->astream[i].rbuffer.high*100/
+			      rx->astream[i].rbuffer.size));
+	for (i=0; i < rx->ac3n; i++)
+		fprintf(stderr,", ac3%d max %d%%", i, 
+			(int)((uint64_t)rx->ac3stream[i].rbuffer.high*100/
+			      rx->ac3stream[i].rbuffer.size));
+	fprintf(stderr,"; -g %d would do\n", g);
+}
+
+/* hand the limits of the output type to -Y rate once the sequence
+   header and all audio frames are known, or at the end without them */
+static int rate_setup(struct replex *rx, int force)
+{
+	multiplex_t mx;
+	int i;
+
+	if (!force){
+		if (!rx->seq_head.set) return 0;
+		for (i=0; i < rx->apidn; i++)
+			if (!rx->astream[i].frame.set) return 0;
+		for (i=0; i < rx->ac3n; i++)
+			if (!rx->ac3stream[i].frame.set) return 0;
+	}
+	memset(&mx, 0, sizeof(mx));
+	mx.video_delay = rx->video_delay;
+	mx.audio_delay = rx->audio_delay;
+	mux_limits(&mx, &rx->seq_head, rx->astream, rx->ac3stream,
+		   rx->apidn, rx->ac3n, rx->otype, rx->low_latency);
+	rate_limits(&mx, &rx->seq_head);
+	return 1;
+}
+
 void replex_finish(struct replex *rx)
 {
+	struct replex *s;
+	int n = 1;
 	
+	if (rx->analyze){
+		if (rx->analyze_format == AN_RATE) rate_setup(rx, 1);
+		analyze_finish();
+	}
 	fprintf(stderr,"\n");
-	if (!replex_all_set(rx)){
-		fprintf(stderr,"Can't find all required streams\n");
-		if (rx->itype == REPLEX_PS){
-			fprintf(stderr,"Please check if audio and video have standard IDs (0xc0 or 0xe0)\n");
+	if (rx->ts_resyncs)
+		fprintf(stderr,"lost TS sync %d times, dropped %lld bytes\n",
+			rx->ts_resyncs, (long long)rx->ts_dropped);
+	for (s = rx; s; s = s->next, n++){
+		if (rx->next) fprintf(stderr,"program %d:\n", n);
+		if (s->itype == REPLEX_TS)
+			ts_loss_report(s);
+		if (s->clock.discons)
+			fprintf(stderr,"%d clock discontinuities on PID 0x%04x\n",
+				s->clock.discons, s->clock.pid);
+		buffer_report(s);
+		if (s->low_latency && !rx->demux){
+			multiplex_t *mx = (multiplex_t *)s->priv;
+
+			if (mx->lat_n)
+				fprintf(stderr,"latency: average %.1f ms  maximum %.1f ms\n",
+					mx->lat_sum/1000./mx->lat_n,
+					mx->lat_max/1000.);
+		}
+		if (!replex_all_set(s)){
+			fprintf(stderr,"Can't find all required streams\n");
+			if (s->itype == REPLEX_PS){
+				fprintf(stderr,"Please check if audio and video have standard IDs (0xc0 or 0xe0)\n");
+			}
+			exit(1);
 		}
-		exit(1);
 	}
 	
-	if (!rx->demux)
-		finish_mpg((multiplex_t *)rx->priv);
+	if (!rx->demux){
+		for (s = rx; s; s = s->next)
+			finish_mpg((multiplex_t *)s->priv);
+		checkpoint_finish();
+	}
+	stats_report();
 	exit(0);
 }
 
+// the program a packet belongs to, NULL if that one is finished
+static struct replex *ts_program(struct replex *rx, uint8_t *tsp)
+{
+	struct replex *s;
+
+	if (!rx->pidmap || !(s = rx->pidmap[get_pid(tsp+1)])) s = rx;
+	if (s->done) return NULL;
+	return s;
+}
+
+/* Skip to the next position from which the packets are in sync, move
+   the rest of the block to the start of buf and complete its last
+   packet again. A sync byte in the last packet of the block is only
+   taken once the next packet has been read to confirm it. Returns the
+   new offset in buf. */
+static int replex_ts_resync(struct replex *rx, uint8_t *buf, int j, int *re)
+{
+	int stride = rx->ts_stride;
+	int pf = rx->ts_prefix;
+	int s, rest, re2;
+	int dropped = 0;
+
+	rx->ts_resyncs++;
+	while ((s = ts_find_sync(buf+j+pf, *re-j-pf, stride)) == TS_MORE){
+		int keep = *re-stride-pf;
+
+		if (keep < j) keep = j;
+		dropped += keep-j;
+		memmove(buf, buf+keep, *re-keep);
+		*re -= keep;
+		j = 0;
+		if ((re2 = save_read(rx, buf+*re, stride)) <= 0){
+			s = -1;
+			break;
+		}
+		*re += re2;
+	}
+	if (s < 0){
+		dropped += *re-j;
+		fprintf(stderr,"lost TS sync, dropped %d bytes\n", dropped);
+		rx->ts_dropped += dropped;
+		return *re;
+	}
+	dropped += s;
+	fprintf(stderr,"lost TS sync, dropped %d bytes\n", dropped);
+	rx->ts_dropped += dropped;
+	memmove(buf, buf+j+s, *re-j-s);
+	*re -= j+s;
+
+	if ((rest = *re%stride)){
+		if ((re2 = save_read(rx, buf+*re, stride-rest)) > 0)
+			*re += re2;
+	}
+	return 0;
+}
+
 int replex_fill_buffers(struct replex *rx, uint8_t *mbuf)
 {
-	uint8_t buf[IN_SIZE];
+	uint8_t buf[IN_SIZE+TS_MAX_SIZE];
 	int i,j;
 	int count=0;
 	int fill;
 	int re;
 	int rsize;
 	int tries = 0;
+	int bad;
+	int st;
+	int stride = rx->ts_stride;
+	int pf = rx->ts_prefix;
+	int in_size = rx->low_latency ? LL_IN_SIZE : IN_SIZE;
+	struct replex *s;
 
 	if (rx->finish) return 0;
 	fill =  guess_fill(rx);
 	//fprintf(stderr,"trying to fill buffers with %d\n",fill);
 	if (fill < 0) return -1;
+	fill = shared_fill(rx, fill);
+	if (rx->in) rx = rx->in;   // the first program reads for all
 
 	memset(buf, 0, IN_SIZE);
 	
 	switch(rx->itype){
 	case REPLEX_TS:
-		if (fill < IN_SIZE){
-			rsize = fill - (fill%188);
-		} else rsize = IN_SIZE;
+		if (fill < in_size){
+			rsize = fill - (fill%stride);
+		} else rsize = in_size - (in_size%stride);
 		
 //	fprintf(stderr,"filling with %d\n",rsize);
 		
@@ -1760,19 +2176,15 @@ int replex_fill_buffers(struct replex *rx, uint8_t *mbuf)
 		memset(buf, 0, IN_SIZE);
 		
 		if ( mbuf ){
-			for ( i = 0; i < 188 ; i++){
-				if ( mbuf[i] == 0x47 ) break;
-			}
-			
-			if ( i == 188){
+			if (!ts_stride(mbuf, PROBE_SIZE, &pf, &i)){
 				fprintf(stderr,"Not a TS\n");
 				return -1;
 			} else {
-				memcpy(buf,mbuf+i,2*TS_SIZE-i);
+				memcpy(buf,mbuf+i,PROBE_SIZE-i);
 				if ((count = save_read(rx,mbuf,i))<0)
 					perror("reading");
-				memcpy(buf+2*TS_SIZE-i,mbuf,i);
-				i = 188;
+				memcpy(buf+PROBE_SIZE-i,mbuf,i);
+				i = PROBE_SIZE;
 			}
 		} else i=0;
 
@@ -1789,15 +2201,33 @@ int replex_fill_buffers(struct replex *rx, uint8_t *mbuf)
 				find_pids_stdin(rx, buf, re);
 			}
 
-			for( j = 0; j < re; j+= TS_SIZE){
-				
-				if ( re - j < TS_SIZE) break;
+			st = stats_enter(ST_TS);
+			stats_add(ST_TS, re, re/stride);
+			bad = ts_check_sync(buf+pf, re-pf, stride);
+			for( j = 0; j < re; j+= stride){
+				int k;
+
+				if ( re - j < stride) break;
+				if ( j == bad ){
+					j = replex_ts_resync(rx, buf, j, &re);
+					if ( re - j < stride) break;
+					bad = j + ts_check_sync(buf+j+pf, re-j-pf, 
+								stride);
+				}
 				
-				if ( replex_tsp( rx, buf+j) < 0){
+				if (!(s = ts_program(rx, buf+j+pf)))
+					continue;
+				if ((k = replex_ts_cont(s, buf+j+pf, 
+							(bad-j)/stride))){
+					j += (k-1)*stride;
+					continue;
+				}
+				if ( replex_tsp( s, buf+j+pf) < 0){
 					fprintf(stderr, "Error reading TS\n");
 					exit(1);
 				}
 			}
+			stats_leave(st);
 			i=0;
 		}
 		
@@ -1808,9 +2238,9 @@ int replex_fill_buffers(struct replex *rx, uint8_t *mbuf)
 		
 	case REPLEX_PS:
 		rsize = fill;
-		if (fill > IN_SIZE) rsize = IN_SIZE; 
+		if (fill > in_size) rsize = in_size; 
 		if (mbuf)
-			get_pes(&rx->pvideo, mbuf, 2*TS_SIZE, pes_es_out);
+			get_pes(&rx->pvideo, mbuf, PROBE_SIZE, pes_es_out);
 		
 		while (count < rsize && tries < MAX_TRIES){
 			if ((re = save_read(rx, buf, rsize))<0)
@@ -1818,7 +2248,10 @@ int replex_fill_buffers(struct replex *rx, uint8_t *mbuf)
 			else 
 				count += re;
 	
+			st = stats_enter(ST_PES);
 			get_pes(&rx->pvideo, buf, re, pes_es_out);
+			stats_add(ST_PES, re, 0);
+			stats_leave(st);
 			
 			tries++;
 			
@@ -1846,7 +2279,10 @@ int replex_fill_buffers(struct replex *rx, uint8_t *mbuf)
 				else 
 					count += re;
 				
+				st = stats_enter(ST_PES);
 				get_avi(&rx->pvideo, buf, re, avi_es_out);
+				stats_add(ST_PES, re, 0);
+				stats_leave(st);
 				
 				tries++;
 			}
@@ -1868,10 +2304,14 @@ int replex_fill_buffers(struct replex *rx, uint8_t *mbuf)
 int fill_buffers(void *r, int finish)
 {
 	struct replex *rx = (struct replex *)r;
+	int st = stats_enter(ST_READ);
+	int re;
 	
 	rx->finish = finish;
 
-	return replex_fill_buffers(rx, NULL);
+	re = replex_fill_buffers(rx, NULL);
+	stats_leave(st);
+	return re;
 }
 
 
@@ -1887,10 +2327,10 @@ static int replex_all_set(struct replex *rx)
 	int set=0;
 
 	for (i=0;  i < rx->ac3n ;i++){
-		set += rx->ac3frame[i].set;
+		set += rx->ac3stream[i].frame.set;
 	}
 	for (i=0; i<rx->apidn;i++){
-		set += rx->aframe[i].set;
+		set += rx->astream[i].frame.set;
 	}
 	set += rx->seq_head.set;
 
@@ -1902,23 +2342,27 @@ static int replex_all_set(struct replex *rx)
 int check_stream_type(struct replex *rx, uint8_t * buf, int len)
 {
 	int c=0;
+	int start;
 	avi_context ac;
 	uint8_t head;
 
+	rx->ts_stride = TS_SIZE;
+	rx->ts_prefix = 0;
 	if (rx->itype != REPLEX_TS) return rx->itype;
 
-	if (len< 2*TS_SIZE){
+	if (len< PROBE_SIZE){
 		fprintf(stderr,"cannot determine streamtype");
 		exit(1);
 	}
 
 	fprintf(stderr, "Checking for TS: ");
-	while (c < len && buf[c]!=0x47) c++;
-	if (c<len && len-c>=TS_SIZE){
-		if (buf[c+TS_SIZE] == 0x47){
+	if ((c = ts_stride(buf, len, &rx->ts_prefix, &start))){
+		rx->ts_stride = c;
+		if (c == TS_SIZE)
 			fprintf(stderr,"confirmed\n");
-			return REPLEX_TS;
-		} else  fprintf(stderr,"failed\n");
+		else 
+			fprintf(stderr,"confirmed (%d byte packets)\n", c);
+		return REPLEX_TS;
 	} else  fprintf(stderr,"failed\n");
 
 	fprintf(stderr, "Checking for AVI: ");
@@ -1948,31 +2392,152 @@ int check_stream_type(struct replex *rx, uint8_t * buf, int len)
 }
 
 
-void init_replex(struct replex *rx,int bufsize)
+static audio_stream_t *alloc_audio_streams(struct replex *rx, int type,
+					   uint16_t *ids, int n)
 {
+	audio_stream_t *streams;
 	int i;
-	uint8_t mbuf[2*TS_SIZE];
-	
+
+	if (!n) return NULL;
+	if (!(streams = calloc(n, sizeof(audio_stream_t)))){
+		fprintf(stderr,"Not enough memory for audio streams\n");
+		exit(1);
+	}
+
+	for (i=0; i<n; i++){
+		audio_stream_t *as = &streams[i];
+
+		as->type = type;
+		as->id = ids[i];
+		as->state = S_SEARCH;
+		if (type == AC3)
+			ring_init(&as->rbuffer, rx->ac3buf);
+		else
+			ring_init(&as->rbuffer, rx->audiobuf);
+
+		if (rx->itype == REPLEX_TS){
+			init_pes_in(&as->pes, type == AC3 ? 0x80+i : i+1, 
+				    &as->rbuffer, 0);
+			as->pes.priv = (void *) rx;
+		}
+		ring_init(&as->index_rbuffer, INDEX_BUF);
+		init_index(&as->current_index);
+	}
+	return streams;
+}
+
+/* Look up the PIDs of the programs given by number in the PAT and
+   PMTs at the start of the input. */
+static void find_program_pids(struct replex *rx)
+{
+	uint8_t buf[IN_SIZE];
+	uint16_t pmt[N_PROG];
+	int found[N_PROG];
+	uint64_t finread = rx->finread;
+	off_t pos = lseek(rx->fd_in, 0, SEEK_CUR);
+	int count=0;
+	int left=0;
+	int re, n;
+	struct replex *s;
+
+	if (!rx->inflength){
+		fprintf(stderr,"Program numbers need an input file\n");
+		exit(1);
+	}
+	memset(pmt, 0, sizeof(pmt));
+	memset(found, 0, sizeof(found));
+	lseek(rx->fd_in, 0, SEEK_SET);
+
+	fprintf(stderr,"Trying to find programs\n");
+	do {
+		if ((re = save_read(rx, buf, IN_SIZE-IN_SIZE%rx->ts_stride)) <= 0)
+			break;
+		count += re;
+		left = 0;
+		for (s = rx, n = 0; s; s = s->next, n++){
+			if (!s->program || found[n]) continue;
+			if (!pmt[n]) 
+				pmt[n] = find_pmt_pid(s->program, buf, re, 
+						      rx->ts_stride);
+			if (pmt[n] && 
+			    (found[n] = find_pmt_pids(pmt[n], buf, re, 
+						      rx->ts_stride, &s->vpid, 
+						      s->apid, &s->apidn, 
+						      N_AUDIO, s->ac3_id, 
+						      &s->ac3n, N_AC3))){
+				int i;
+
+				fprintf(stderr,"program %d: vpid 0x%04x",
+					s->program, s->vpid);
+				for (i=0; i < s->apidn; i++)
+					fprintf(stderr,"  apid 0x%04x", s->apid[i]);
+				for (i=0; i < s->ac3n; i++)
+					fprintf(stderr,"  ac3pid 0x%04x", 
+						s->ac3_id[i]);
+				fprintf(stderr,"\n");
+			} else left++;
+		}
+	} while (left && count < 50000000);
+
+	lseek(rx->fd_in, pos, SEEK_SET);
+	rx->finread = finread;
+	if (left){
+		fprintf(stderr,"Couldn't find all programs\n");
+		exit(1);
+	}
+}
+
+static void map_pid(struct replex *rx, struct replex *s, uint16_t pid)
+{
+	if (rx->pidmap[pid] && rx->pidmap[pid] != s){
+		fprintf(stderr,"PID 0x%04x is used by two programs\n", pid);
+		exit(1);
+	}
+	rx->pidmap[pid] = s;
+}
+
+/* Several programs are read from the same input by the first one,
+   which routes each packet to its program through the PID map. */
+static void init_programs(struct replex *rx)
+{
+	struct replex *s;
+	int i, n;
+	int numbers = 0;
+
+	for (s = rx; s; s = s->next){
+		s->ts_stride = rx->ts_stride;
+		s->ts_prefix = rx->ts_prefix;
+		if (s->program) numbers = 1;
+	}
+	if (numbers) find_program_pids(rx);
+
+	if (!rx->next) return;
+	if (!(rx->pidmap = calloc(0x2000, sizeof(struct replex *)))){
+		fprintf(stderr,"Not enough memory for PID map\n");
+		exit(1);
+	}
+	for (s = rx, n = 1; s; s = s->next, n++){
+		if (!s->vpid || !(s->apidn || s->ac3n)){
+			fprintf(stderr,"program %d: need video and audio PIDs\n",
+				n);
+			exit(1);
+		}
+		if (s != rx) s->in = rx;
+		map_pid(rx, s, s->vpid);
+		for (i=0; i < s->apidn; i++) map_pid(rx, s, s->apid[i]);
+		for (i=0; i < s->ac3n; i++) map_pid(rx, s, s->ac3_id[i]);
+	}
+}
+
+static void init_replex_buffers(struct replex *rx, int bufsize)
+{
 	int VIDEO_BUF, AUDIO_BUF, AC3_BUF;
 
+	rx->bufsize = bufsize;
 	VIDEO_BUF = bufsize;
 	AUDIO_BUF = (VIDEO_BUF/10);
 	AC3_BUF   = (VIDEO_BUF/10);
 
-	rx->analyze=0;
-
-	if (save_read(rx, mbuf, 2*TS_SIZE)<0)
-		perror("reading");
-	
-	check_stream_type(rx, mbuf, 2*TS_SIZE);
-	if (rx->itype == REPLEX_TS){
-		if (!rx->vpid || !(rx->apidn || rx->ac3n)){
-			if (rx->inflength){
-				find_pids_file(rx);
-			}
-		}
-	}	
-
 	if (rx->otype==REPLEX_HDTV){
 		rx->videobuf = 4*VIDEO_BUF;
 	} else {
@@ -2006,41 +2571,34 @@ void init_replex(struct replex *rx,int bufsize)
 	rx->video_state = S_SEARCH;
 	rx->last_vpts = 0;
 
-	for (i=0; i<rx->apidn;i++){
-		
-		rx->apes_abort[i] = 0;
-		rx->audio_state[i] = S_SEARCH;
-		ring_init(&rx->arbuffer[i], rx->audiobuf);
+	rx->astream = alloc_audio_streams(rx, MPEG_AUDIO, rx->apid, 
+					  rx->apidn);
+	rx->ac3stream = alloc_audio_streams(rx, AC3, rx->ac3_id, rx->ac3n);
+}
 
-		if (rx->itype == REPLEX_TS){
-			init_pes_in(&rx->paudio[i], i+1, 
-				    &rx->arbuffer[i], 0);
-			rx->paudio[i].priv = (void *) rx;
-		}
-		ring_init(&rx->index_arbuffer[i], INDEX_BUF);	
-		memset(&rx->aframe[i], 0, sizeof(audio_frame_t));
-		init_index(&rx->current_aindex[i]);
-		rx->aframe_count[i] = 0;
-		rx->first_apts[i] = 0;
-		rx->last_apts[i] = 0;
-	}
+void init_replex(struct replex *rx,int bufsize)
+{
+	uint8_t mbuf[PROBE_SIZE];
+	struct replex *s;
 
-	for (i=0; i<rx->ac3n;i++){
-		rx->ac3pes_abort[i] = 0;
-		rx->ac3_state[i] = S_SEARCH;
-		ring_init(&rx->ac3rbuffer[i], AC3_BUF);
-		if (rx->itype == REPLEX_TS){
-			init_pes_in(&rx->pac3[i], 0x80+i, 
-				    &rx->ac3rbuffer[i],0);
-			rx->pac3[i].priv = (void *) rx;
-		}
-		ring_init(&rx->index_ac3rbuffer[i], INDEX_BUF);
-		memset(&rx->ac3frame[i], 0, sizeof(audio_frame_t));
-		init_index(&rx->current_ac3index[i]);
-		rx->ac3frame_count[i] = 0;
-		rx->first_ac3pts[i] = 0;
-		rx->last_ac3pts[i] = 0;
+	rx->analyze=0;
+
+	if (save_read(rx, mbuf, PROBE_SIZE)<0)
+		perror("reading");
+	
+	check_stream_type(rx, mbuf, PROBE_SIZE);
+	if (rx->itype == REPLEX_TS){
+		if (rx->next || rx->program){
+			init_programs(rx);
+		} else if (!rx->vpid || !(rx->apidn || rx->ac3n)){
+			if (rx->inflength){
+				find_pids_file(rx);
+			}
+		}
 	}	
+
+	for (s = rx; s; s = s->next)
+		init_replex_buffers(s, bufsize);
 	
 	if (rx->itype == REPLEX_TS){
 		if (replex_fill_buffers(rx, mbuf)< 0){
@@ -2103,40 +2661,20 @@ void fix_audio(struct replex *rx, multiplex_t *mx)
 	int i;
 	index_unit aiu;
 	int size;
+	int n = rx->apidn + rx->ac3n;
 
 	size = sizeof(index_unit);
 
-	for ( i = 0; i < rx->apidn; i++){
-		do {
-			while (ring_avail(&rx->index_arbuffer[i]) < 
-			       sizeof(index_unit)){
-				if (replex_fill_buffers(rx, 0)< 0){
-					fprintf(stderr,
-						"error in fix audio\n");
-					exit(1);
-				}	
-			}
-			ring_peek(&rx->index_arbuffer[i], (uint8_t *)&aiu, 
-				  size, 0);
-			if ( ptscmp(aiu.pts + rx->first_apts[i], rx->first_vpts) < 0){
-				ring_skip(&rx->index_arbuffer[i], size);
-				ring_skip(&rx->arbuffer[i], aiu.length);
-			} else break;
+	for ( i = 0; i < n; i++){
+		audio_stream_t *as;
+
+		if (i < rx->apidn)
+			as = &rx->astream[i];
+		else
+			as = &rx->ac3stream[i - rx->apidn];
 
-		} while (1);
-		mx->apts_off[i] = aiu.pts;
-		rx->apts_off[i] = aiu.pts;
-		mx->aframes[i] = aiu.framesize;
-		
-		fprintf(stderr,"Audio%d  offset: ",i);
-		printpts(mx->apts_off[i]);
-		printpts(rx->first_apts[i]+mx->apts_off[i]);
-		fprintf(stderr,"\n");
-	}
-			  
-	for ( i = 0; i < rx->ac3n; i++){
 		do {
-			while (ring_avail(&rx->index_ac3rbuffer[i]) < 
+			while (ring_avail(&as->index_rbuffer) < 
 			       sizeof(index_unit)){
 				if (replex_fill_buffers(rx, 0)< 0){
 					fprintf(stderr,
@@ -2144,21 +2682,23 @@ void fix_audio(struct replex *rx, multiplex_t *mx)
 					exit(1);
 				}	
 			}
-			ring_peek(&rx->index_ac3rbuffer[i],(uint8_t *) &aiu, 
+			ring_peek(&as->index_rbuffer, (uint8_t *)&aiu, 
 				  size, 0);
-			if ( ptscmp (aiu.pts+rx->first_ac3pts[i], rx->first_vpts) < 0){
-				ring_skip(&rx->index_ac3rbuffer[i], size);
-				ring_skip(&rx->ac3rbuffer[i], aiu.length);
+			if ( ptscmp(aiu.pts + as->first_pts, rx->first_vpts) < 0){
+				ring_skip(&as->index_rbuffer, size);
+				ring_skip(&as->rbuffer, aiu.length);
 			} else break;
+
 		} while (1);
-		mx->ac3pts_off[i] = aiu.pts;
-		rx->ac3pts_off[i] = aiu.pts;
-		
-		fprintf(stderr,"AC3%d  offset: ",i);
-		printpts(mx->ac3pts_off[i]);
-		printpts(rx->first_ac3pts[i]+mx->ac3pts_off[i]);
+		as->pts_off = aiu.pts;
+		if (as->type == MPEG_AUDIO){
+			as->framesize = aiu.framesize;
+			fprintf(stderr,"Audio%d  offset: ",i);
+		} else 
+			fprintf(stderr,"AC3%d  offset: ",i - rx->apidn);
+		printpts(as->pts_off);
+		printpts(as->first_pts+as->pts_off);
 		fprintf(stderr,"\n");
-
 	}
 }
 
@@ -2174,163 +2714,74 @@ static int get_next_video_unit(struct replex *rx, index_unit *viu)
 	return 0;
 }
 
-static int get_next_audio_unit(struct replex *rx, index_unit *aiu, int i)
+static int get_next_audio_unit(audio_stream_t *as, index_unit *aiu)
 {
-	if(ring_avail(&rx->index_arbuffer[i])){
-		ring_read(&rx->index_arbuffer[i], (uint8_t *)aiu, 
+	if(ring_avail(&as->index_rbuffer)){
+		ring_read(&as->index_rbuffer, (uint8_t *)aiu, 
 			  sizeof(index_unit));
 		return 1;
 	}
 	return 0;
 }
 
-static int get_next_ac3_unit(struct replex *rx, index_unit *aiu, int i)
-{
-	if (ring_avail(&rx->index_ac3rbuffer[i])){
-		ring_read(&rx->index_ac3rbuffer[i], (uint8_t *)aiu, 
-			  sizeof(index_unit));
-		
-		return 1;
-	} 
-	return 0;
-}
-
 
 void do_analyze(struct replex *rx)
 {
 	index_unit dummy;
 	index_unit dummy2;
 	int i;
-	uint64_t lastvpts;
-	uint64_t lastvdts;
-	uint64_t lastapts[N_AUDIO];
-	uint64_t lastac3pts[N_AC3];
 	int av;
+	int limits = rx->analyze_format != AN_RATE;
 	
 	av = rx->analyze-1;
 
-	lastvpts = 0;
-	lastvdts = 0;
-	memset(lastapts, 0, N_AUDIO*sizeof(uint64_t));
-	memset(lastac3pts, 0, N_AC3*sizeof(uint64_t));
-	
 	fprintf(stderr,"STARTING ANALYSIS\n");
-	
+	analyze_init(rx->analyze_format);
 	
 	while(!rx->finish){
 		if (replex_fill_buffers(rx, 0)< 0){
 			fprintf(stderr,"error in get next video unit\n");
-			return;
+			break;
 		}
+		if (!limits) limits = rate_setup(rx, 0);
 		for (i=0; i< rx->apidn; i++){
-			while(get_next_audio_unit(rx, &dummy2, i)){
-				ring_skip(&rx->arbuffer[i], 
+			while(get_next_audio_unit(&rx->astream[i], &dummy2)){
+				ring_skip(&rx->astream[i].rbuffer, 
 					  dummy2.length);
-				if (av>=1){
-					fprintf(stdout,
-						"MPG2 Audio%d unit: ",
-						i);
-					fprintf(stdout,
-						" length %d  PTS ",
-						dummy2.length);
-					printptss(dummy2.pts);
-					
-					if (lastapts[i]){
-						fprintf(stdout,"  diff:");
-						printptss(ptsdiff(dummy2.pts,lastapts[i]));
-					}
-					lastapts[i] = dummy2.pts;
-					
-					fprintf(stdout,"\n");
-				}
+				if (av>=1) analyze_unit(AN_MPA, i, &dummy2);
 			}
 		}
 		
 		for (i=0; i< rx->ac3n; i++){
-			while(get_next_ac3_unit(rx, &dummy2, i)){
-				ring_skip(&rx->ac3rbuffer[i], 
+			while(get_next_audio_unit(&rx->ac3stream[i], &dummy2)){
+				ring_skip(&rx->ac3stream[i].rbuffer, 
 					  dummy2.length);
-				if (av>=1){
-					fprintf(stdout,
-						"AC3 Audio%d unit: ",
-						i);
-					fprintf(stdout,
-						" length %d  PTS ",
-						dummy2.length);
-					printptss(dummy2.pts);
-					if (lastac3pts[i]){
-						fprintf(stdout,"  diff:");
-						printptss(ptsdiff(dummy2.pts, lastac3pts[i]));
-					}
-					lastac3pts[i] = dummy2.pts;
-					
-					fprintf(stdout,"\n");
-				}
+				if (av>=1) analyze_unit(AN_AC3, i, &dummy2);
 			}
 		}
 		
 		while (get_next_video_unit(rx, &dummy)){
 			ring_skip(&rx->vrbuffer,
 				  dummy.length);
-			if (av==0 || av==2){
-				fprintf(stdout,
-					"Video unit: ");
-	                        if (dummy.seq_header){
-					fprintf(stdout,"Sequence header ");
-				}
-				if (dummy.gop){
-					fprintf(stdout,"GOP header ");
-				}
-				switch (dummy.frame){
-				case I_FRAME:
-					fprintf(stdout, "I-frame");
-					break;
-				case B_FRAME:
-					fprintf(stdout, "B-frame");
-					break;
-				case P_FRAME:
-					fprintf(stdout, "P-frame");
-					break;
-				}
-				fprintf(stdout,
-					" length %d  PTS ",
-					dummy.length);
-				printptss(dummy.pts);
-				if (lastvpts){
-					fprintf(stdout,"  diff:");
-					printptss(ptsdiff(dummy.pts, lastvpts));
-				}
-				lastvpts = dummy.pts;
-					
-				fprintf(stdout,
-					"  DTS ");
-				printptss(dummy.dts);
-				if (lastvdts){
-					fprintf(stdout,"  diff:");
-					printptss(ptsdiff(dummy.dts,lastvdts));
-				}
-				lastvdts = dummy.dts;
-					
-				fprintf(stdout,"\n");
-			}
+			if (av==0 || av==2) analyze_unit(AN_VIDEO, 0, &dummy);
 		}
 	}
-
-
+	if (!limits) rate_setup(rx, 1);
+	analyze_finish();
 }
 
 void do_scan(struct replex *rx)
 {
-	uint8_t mbuf[2*TS_SIZE];
+	uint8_t mbuf[PROBE_SIZE];
 	
 	rx->analyze=0;
 
-	if (save_read(rx, mbuf, 2*TS_SIZE)<0)
+	if (save_read(rx, mbuf, PROBE_SIZE)<0)
 		perror("reading");
 	
 	fprintf(stderr,"STARTING SCAN\n");
 	
-	check_stream_type(rx, mbuf, 2*TS_SIZE);
+	check_stream_type(rx, mbuf, PROBE_SIZE);
 
 	switch(rx->itype){
 	case REPLEX_TS:
@@ -2372,16 +2823,17 @@ void do_demux(struct replex *rx)
 			return;
 		}
 		for (i=0; i< rx->apidn; i++){
-			while(get_next_audio_unit(rx, &dummy2, i)){
+			while(get_next_audio_unit(&rx->astream[i], &dummy2)){
 				switch(dummy2.err){
 				case JUMP_ERR:
-					ring_skip(&rx->arbuffer[i],dummy2.length);
+					ring_skip(&rx->astream[i].rbuffer,
+						  dummy2.length);
 					break;
 				case DUMMY_ERR:
 					write(rx->dmx_out[i+1],dummy.fillframe,dummy2.length);
 					break; 
 				default:
-					ring_read_file(&rx->arbuffer[i], 
+					ring_read_file(&rx->astream[i].rbuffer, 
 						       rx->dmx_out[i+1], 
 						       dummy2.length);
 				}
@@ -2389,16 +2841,17 @@ void do_demux(struct replex *rx)
 		}
 		
 		for (i=0; i< rx->ac3n; i++){
-			while(get_next_ac3_unit(rx, &dummy2, i)){
+			while(get_next_audio_unit(&rx->ac3stream[i], &dummy2)){
 				switch(dummy2.err){
 				case JUMP_ERR:
-					ring_skip(&rx->ac3rbuffer[i],dummy2.length);
+					ring_skip(&rx->ac3stream[i].rbuffer,
+						  dummy2.length);
 					break;
 				case DUMMY_ERR:
 					write(rx->dmx_out[i+1+rx->apidn],dummy.fillframe,dummy2.length);
 					break; 
 				default:
-					ring_read_file(&rx->ac3rbuffer[i], 
+					ring_read_file(&rx->ac3stream[i].rbuffer, 
 						       rx->dmx_out[i+1+rx->apidn], 
 						       dummy2.length);
 				}
@@ -2413,57 +2866,155 @@ void do_demux(struct replex *rx)
 }
 
 
+static int ring_percent(ringbuffer *rbuf)
+{
+	return (int)((uint64_t)ring_avail(rbuf)*100/rbuf->size);
+}
+
+/* With several programs the one with the fullest input buffers is
+   multiplexed next, so that none of them falls behind and overflows. */
+static int next_program(struct replex **rs, int *done, int n)
+{
+	int i, j;
+	int next = -1;
+	int max = -1;
+
+	for (i=0; i < n; i++){
+		struct replex *s = rs[i];
+		int f;
+
+		if (done[i]) continue;
+		f = ring_percent(&s->vrbuffer);
+		for (j=0; j < s->apidn; j++)
+			if (ring_percent(&s->astream[j].rbuffer) > f)
+				f = ring_percent(&s->astream[j].rbuffer);
+		for (j=0; j < s->ac3n; j++)
+			if (ring_percent(&s->ac3stream[j].rbuffer) > f)
+				f = ring_percent(&s->ac3stream[j].rbuffer);
+		if (f > max){
+			max = f;
+			next = i;
+		}
+	}
+	return next;
+}
+
 void do_replex(struct replex *rx)
 {
-	int video_ok = 0;
-	int audio_ok[N_AUDIO];
-	int ac3_ok[N_AC3];
-	int start=1;
-	multiplex_t mx;
-	int done = 0;
+	struct replex *rs[N_PROG];
+	multiplex_t *mx[N_PROG];
+	int start[N_PROG];
+	int done[N_PROG];
+	int i, n = 0;
+	struct replex *s;
 
 
 	fprintf(stderr,"STARTING REPLEX\n");
-	memset(&mx, 0, sizeof(mx));
-	memset(audio_ok, 0, N_AUDIO*sizeof(int));
-	memset(ac3_ok, 0, N_AC3*sizeof(int));
 
-	while (!replex_all_set(rx)){
-		if (replex_fill_buffers(rx, 0)< 0){
-			fprintf(stderr,"error filling buffer\n");
+	for (s = rx; s; s = s->next){
+		while (!checkpoint_resume && !replex_all_set(s)){
+			if (replex_fill_buffers(s, 0)< 0){
+				fprintf(stderr,"error filling buffer\n");
+				exit(1);
+			}
+		}
+		if (!(mx[n] = calloc(1, sizeof(multiplex_t)))){
+			fprintf(stderr,"Not enough memory for multiplexer\n");
 			exit(1);
 		}
+		rs[n] = s;
+		start[n] = 1;
+		done[n] = 0;
+		n++;
 	}
 
-	mx.priv = (void *) rx;
-	rx->priv = (void *) &mx;
-	init_multiplex(&mx, &rx->seq_head, rx->aframe, rx->ac3frame, 
-		       rx->apidn, rx->ac3n, rx->video_delay, 
-		       rx->audio_delay, rx->fd_out, fill_buffers,
-		       &rx->vrbuffer, &rx->index_vrbuffer,	
-		       rx->arbuffer, rx->index_arbuffer,
-		       rx->ac3rbuffer, rx->index_ac3rbuffer, rx->otype);
+	for (i=0; i < n; i++){
+		s = rs[i];
+		mx[i]->priv = (void *) s;
+		s->priv = (void *) mx[i];
+		if (checkpoint_resume){
+			mx[i]->fill_buffers = fill_buffers;
+			continue;
+		}
+		init_multiplex(mx[i], &s->seq_head, s->astream, s->ac3stream, 
+			       s->apidn, s->ac3n, s->video_delay, 
+			       s->audio_delay, s->fd_out, fill_buffers,
+			       &s->vrbuffer, &s->index_vrbuffer, s->otype,
+			       s->low_latency);
+	}
 
-	if (!rx->ignore_pts){ 
-		fix_audio(rx, &mx);
+	if (checkpoint_resume){
+		checkpoint_load(rs, mx, start, done, n);
+		for (i=0; i < n; i++)
+			rs[i]->done = done[i];
+	} else for (i=0; i < n; i++){
+		if (!rs[i]->ignore_pts){ 
+			fix_audio(rs[i], mx[i]);
+		}
+		setup_multiplex(mx[i]);
 	}
-	setup_multiplex(&mx);
 
-	do {
-		check_times( &mx, &video_ok, audio_ok, ac3_ok, &start);
+	while ((i = next_program(rs, done, n)) >= 0){
+		check_times( mx[i], &start[i]);
 
-		write_out_packs( &mx, video_ok, audio_ok, ac3_ok);
+		write_out_packs( mx[i]);
 	
-		if (mx.max_reached) done = 1;
-		if (mx.zero_write_count >100){
+		if (mx[i]->max_reached) done[i] = 1;
+		if (mx[i]->zero_write_count >100){
 			fprintf(stderr,"Can`t continue, check input file\n");
-			done=1;
+			done[i]=1;
 		}
-	} while (!done);
+		rs[i]->done = done[i];
+		if (checkpoint_due(mx[i], i))
+			checkpoint_write(rs, mx, start, done, n);
+	}
 	
 }
 
 
+static void copy_selection(struct replex *to, struct replex *from)
+{
+	to->program = from->program;
+	to->vpid = from->vpid;
+	to->apidn = from->apidn;
+	memcpy(to->apid, from->apid, sizeof(to->apid));
+	to->ac3n = from->ac3n;
+	memcpy(to->ac3_id, from->ac3_id, sizeof(to->ac3_id));
+}
+
+/* The programs selected with -P share the options and the input of rx
+   and get their own output file. */
+static void setup_programs(struct replex *rx, struct replex **progs, 
+			   char **files, int n)
+{
+	struct replex **last = &rx->next;
+	int i;
+
+	for (i=0; i < n; i++){
+		struct replex *s = progs[i];
+		struct replex sel = *s;
+
+		if (!files[i]){
+			fprintf(stderr,"Program %d needs an output file\n", i+2);
+			exit(1);
+		}
+		*s = *rx;
+		s->next = NULL;
+		copy_selection(s, &sel);
+		if ((s->fd_out = open(files[i],O_WRONLY|O_CREAT|O_LARGEFILE
+				      |(checkpoint_resume ? 0 : O_TRUNC),
+				      S_IRUSR|S_IWUSR|S_IRGRP|
+				      S_IWGRP|
+				      S_IROTH|S_IWOTH)) < 0){
+			perror("Error opening output file");
+			exit(1);
+		}
+		fprintf(stderr,"Output File is: %s\n", files[i]);
+		*last = s;
+		last = &s->next;
+	}
+}
+
 void usage(char *progname)
 {
         printf ("usage: %s [options] <input files>\n\n",progname);
@@ -2474,20 +3025,29 @@ void usage(char *progname)
         printf ("  --ac3_id,           -c <integer>  :  ID of AC3 audio for demux (also used for PS id, i.e. 0x80)\n");
         printf ("  --video_delay,      -d <integer>  :  video delay in ms\n");
         printf ("  --audio_delay,      -e <integer>  :  audio delay in ms\n");
+        printf ("  --checkpoint,       -C <integer>  :  write a checkpoint to <output>.ckp every <int> MB of output\n");
         printf ("  --ignore_PTS,       -f            :  ignore all PTS information of original\n");
 	printf ("  --larger_buffer     -g <integer>  :  video buffer in MB\n"); 
         printf ("  --input_stream,     -i <string>   :  set input stream type (string = TS(default), PS, AVI)\n");
         printf ("  --allow_jump,       -j            :  allow jump in the PTS and try repair\n");
         printf ("  --keep_PTS,         -k            :  keep and don't correct PTS information of original\n");
+        printf ("  --low_latency,      -L            :  smaller reads and buffers, shorter startup delay and video lead (for live streaming)\n");
 	printf ("  --min_jump,         -l <integer>  :  don't try to fix jumps in PTS larger than <int> but treat them as a cut (default 100ms)\n");
         printf ("  --of,               -o <filename> :  set output file\n");
+        printf ("  --program,          -P <integer>  :  remux a further program, by PMT program number or 0 for the following -v, -a, -c and -o\n");
 	printf ("  --fillzero          -p            :  fill audio frames with zeros (only MPEG AUDIO)\n");
+	printf ("  --follow,           -F <integer>  :  follow a growing input file until its writer closes it or no data arrives for <int> seconds\n");
 	printf ("  --max_overflow      -q <integer>  :  max_number of overflows allowed (default: 100, 0=no restriction)\n");
+        printf ("  --resume,           -R            :  continue an interrupted run from <output>.ckp (same options and input)\n");
         printf ("  --scan,             -s            :  scan for streams\n");
+        printf ("  --stats,            -S            :  print the time spent in each stage at the end\n");
         printf ("  --type,             -t <string>   :  set output type (string = MPEG2, DVD, HDTV)\n");
         printf ("  --video_pid,        -v <integer>  :  video PID for TS stream (also used for PS id, default 0xe0)\n");
         printf ("  --vdr,              -x            :  handle AC3 for vdr input file\n");
+        printf ("  --checkpoint_stop,  -X            :  stop after the first checkpoint of -C, to test -R\n");
+        printf ("  --verify,           -V            :  check a program stream against the buffers and rules of -t (default MPEG2)\n");
         printf ("  --analyze,          -y <integer>  :  analyze (0=video,1=audio, 2=both)\n");
+        printf ("  --analyze_format,   -Y <string>   :  output of -y (string = text(default), csv, json, bin, summary, rate)\n");
         printf ("  --demux,            -z            :  demux only (-o is basename)\n");
         exit(1);
 }
@@ -2497,14 +3057,21 @@ int main(int argc, char **argv)
         int c;
 	int analyze=0;
 	int scan =0;
+	int verify = 0;
+	uint64_t checkpoint = 0;
+	int resume = 0;
         char *filename = NULL;
         char *type = "SVCD";
         char *inpt = "TS";
-	int bufsize = 6*1024*1024;
+	int bufsize = 0;
 	uint64_t min_jump=0;
 	int fillzero = 0;
 
 	struct replex rx;
+	struct replex *cur = &rx;
+	struct replex *progs[N_PROG];
+	char *pfiles[N_PROG];
+	int nprog = 0;
 
 	fprintf(stderr,"replex version %s\n", VERSION);
 
@@ -2516,10 +3083,12 @@ int main(int argc, char **argv)
                 static struct option long_options[] = {
 			{"audio_pid", required_argument, NULL, 'a'},
 			{"ac3_id", required_argument, NULL, 'c'},
+			{"checkpoint", required_argument, NULL, 'C'},
 			{"video_delay", required_argument, NULL, 'd'},
 			{"audio_delay", required_argument, NULL, 'e'},
 			{"ignore_PTS",required_argument, NULL, 'f'},
 			{"larger_buffer",required_argument, NULL, 'g'},
+			{"low_latency",no_argument, NULL, 'L'},
 			{"help", no_argument , NULL, 'h'},
 			{"input_stream", required_argument, NULL, 'i'},
 			{"allow_jump",required_argument, NULL, 'j'},
@@ -2527,38 +3096,50 @@ int main(int argc, char **argv)
 			{"min_jump",required_argument, NULL, 'l'},
 			{"of",required_argument, NULL, 'o'},
 			{"fillzero",required_argument, NULL, 'p'},
+			{"follow",required_argument, NULL, 'F'},
 			{"max_overflow",required_argument, NULL, 'q'},
+			{"resume",no_argument, NULL, 'R'},
+			{"program",required_argument, NULL, 'P'},
 			{"scan",required_argument, NULL, 's'},
+			{"stats",no_argument, NULL, 'S'},
 			{"type", required_argument, NULL, 't'},
 			{"video_pid", required_argument, NULL, 'v'},
 			{"vdr",required_argument, NULL, 'x'},
+			{"checkpoint_stop",no_argument, NULL, 'X'},
+			{"verify",no_argument, NULL, 'V'},
 			{"analyze",required_argument, NULL, 'y'},
+			{"analyze_format",required_argument, NULL, 'Y'},
 			{"demux",no_argument, NULL, 'z'},
 			{0, 0, 0, 0}
 		};
                 c = getopt_long (argc, argv, 
-				 "a:c:d:e:fg:hi:jkl:o:pq:st:v:xy:z",
+				 "a:c:C:d:e:fF:g:hi:jkLl:o:pP:q:RsSt:v:VxXy:Y:z",
                                  long_options, &option_index);
                 if (c == -1)
                         break;
 
                 switch (c){
                 case 'a':
-			if (rx.apidn==N_AUDIO){
+			if (cur->apidn==N_AUDIO){
 				fprintf(stderr,"Too many audio PIDs\n");
 				exit(1);
 			}
-                        rx.apid[rx.apidn] = strtol(optarg,(char **)NULL, 0);
-			rx.apidn++;
+                        cur->apid[cur->apidn] = strtol(optarg,(char **)NULL, 0);
+			cur->apidn++;
                         break;
                 case 'c':
-			if (rx.ac3n==N_AC3){
+			if (cur->ac3n==N_AC3){
 				fprintf(stderr,"Too many audio PIDs\n");
 				exit(1);
 			}
-                        rx.ac3_id[rx.ac3n] = strtol(optarg,(char **)NULL, 0);
-			rx.ac3n++;
+                        cur->ac3_id[cur->ac3n] = strtol(optarg,(char **)NULL, 0);
+			cur->ac3n++;
                         break;
+		case 'C':
+			checkpoint = strtol(optarg,(char **)NULL, 0) 
+				*1024*1024ULL;
+			if (!checkpoint) usage(argv[0]);
+			break;
 		case 'd':
 			rx.video_delay = strtol(optarg,(char **)NULL, 0) 
 				*CLOCK_MS;
@@ -2570,6 +3151,9 @@ int main(int argc, char **argv)
 		case 'f':
 			rx.ignore_pts =1;
 			break;
+		case 'F':
+			rx.follow = strtol(optarg,(char **)NULL, 0);
+			break;
 		case 'g':
 			bufsize = strtol(optarg,(char **)NULL, 0) *1024*1024; 
 			break;
@@ -2582,35 +3166,70 @@ int main(int argc, char **argv)
 		case 'k':
 			rx.keep_pts =1;
 			break;
+		case 'L':
+			rx.low_latency = 1;
+			break;
 		case 'l':
 			min_jump = strtol(optarg,(char **)NULL, 0) *CLOCK_MS; 
 			break;
                 case 'o':
-                        filename = optarg;
+			if (cur == &rx)
+				filename = optarg;
+			else 
+				pfiles[nprog-1] = optarg;
                         break;
+		case 'P':
+			if (nprog == N_PROG-1){
+				fprintf(stderr,"Too many programs\n");
+				exit(1);
+			}
+			if (!(cur = calloc(1, sizeof(struct replex)))){
+				fprintf(stderr,"Not enough memory\n");
+				exit(1);
+			}
+			cur->program = strtol(optarg,(char **)NULL, 0);
+			pfiles[nprog] = NULL;
+			progs[nprog++] = cur;
+			break;
 		case 'p':
 			fillzero = 1;
 			break;
 		case 'q':
 			rx.max_overflows = strtol(optarg,(char **)NULL, 0); 
 			break;
+		case 'R':
+			resume = 1;
+			break;
 		case 's':
 			scan = 1;
 			break;
+		case 'S':
+			stats_init();
+			break;
                 case 't':
                         type = optarg;
                         break;
                 case 'v':
-                        rx.vpid = strtol(optarg,(char **)NULL, 0);
+                        cur->vpid = strtol(optarg,(char **)NULL, 0);
                         break;
+		case 'V':
+			verify = 1;
+			break;
 		case 'x':
 			rx.vdr=1;
 			break;
+		case 'X':
+			checkpoint_stop = 1;
+			break;
 		case 'y':
 			analyze = strtol(optarg,(char **)NULL, 0);
 			if (analyze>2) usage(argv[0]);
 			analyze++;
 			break;
+		case 'Y':
+			if ((rx.analyze_format = analyze_format(optarg)) < 0)
+				usage(argv[0]);
+			break;
 		case 'z':
 			rx.demux = 1;
 			break;
@@ -2622,6 +3241,32 @@ int main(int argc, char **argv)
         }
 
 	if (rx.allow_jump && min_jump) rx.allow_jump = min_jump;
+	if (!bufsize) 
+		bufsize = rx.low_latency ? LL_VIDEO_BUF : 6*1024*1024;
+
+	// without PIDs of its own the first program is the first -P one
+	if (nprog && !rx.vpid && !rx.apidn && !rx.ac3n){
+		int i;
+
+		copy_selection(&rx, progs[0]);
+		if (pfiles[0]) filename = pfiles[0];
+		free(progs[0]);
+		for (i=1; i < nprog; i++){
+			progs[i-1] = progs[i];
+			pfiles[i-1] = pfiles[i];
+		}
+		nprog--;
+	}
+
+	if (checkpoint_stop && !checkpoint) usage(argv[0]);
+	if (checkpoint || resume){
+		if (!filename || optind >= argc || rx.demux || analyze || 
+		    scan || verify){
+			fprintf(stderr,"Checkpoints need input files and an output file\n");
+			exit(1);
+		}
+		checkpoint_init(filename, checkpoint, resume);
+	}
 
 	if (fillzero) rx.fillzero = 1;
 	rx.inputFiles = NULL;
@@ -2641,26 +3286,48 @@ int main(int argc, char **argv)
 		rx.inputFiles[i] = NULL;
 		rx.inputIdx = 0;
 		if ((rx.fd_in = open(rx.inputFiles[0] ,O_RDONLY| O_LARGEFILE)) < 0) {
-			fprintf(stderr,"Error opening input file %s",argv[optind] );
+			fprintf(stderr,"Error opening input file %s",rx.inputFiles[0] );
 			exit(1);
 		}
 
-                fprintf(stderr,"Reading from %s\n", argv[optind]);
+                fprintf(stderr,"Reading from %s\n", rx.inputFiles[0]);
 		rx.inflength = lseek(rx.fd_in, 0, SEEK_END);
 		fprintf(stderr,"Input file length: %.2f MB\n",rx.inflength/1024./1024.);
 		lseek(rx.fd_in,0,SEEK_SET);
 		rx.lastper = 0;
 		rx.finread = 0;
+
+		if (rx.follow){
+			struct stat st;
+
+			if (stat(rx.inputFiles[i-1], &st) < 0 ||
+			    !S_ISREG(st.st_mode)){
+				fprintf(stderr,"Following needs a regular input file\n");
+				exit(1);
+			}
+			if ((rx.follow_fd = inotify_init()) < 0 ||
+			    inotify_add_watch(rx.follow_fd, rx.inputFiles[i-1],
+					      IN_MODIFY|IN_CLOSE_WRITE) < 0){
+				perror("Error watching input file");
+				exit(1);
+			}
+			fprintf(stderr,"Following %s\n", rx.inputFiles[i-1]);
+		}
         } else {
+		if (rx.follow){
+			fprintf(stderr,"Following needs a regular input file\n");
+			exit(1);
+		}
 		fprintf(stderr,"using stdin as input\n");
 		rx.fd_in = STDIN_FILENO;
 		rx.inflength = 0;
         }
 
-	if (!rx.demux){
+	if (!rx.demux && !verify){
 		if (filename){
 			if ((rx.fd_out = open(filename,O_WRONLY|O_CREAT
-					      |O_TRUNC|O_LARGEFILE,
+					      |O_LARGEFILE|(checkpoint_resume
+							    ? 0 : O_TRUNC),
 					      S_IRUSR|S_IWUSR|S_IRGRP|
 					      S_IWGRP|
 					      S_IROTH|S_IWOTH)) < 0){
@@ -2689,8 +3356,11 @@ int main(int argc, char **argv)
 		rx.otype=REPLEX_DVD;
 	else if (!strncmp(type,"HDTV",4))
 		rx.otype=REPLEX_HDTV;
-        else if (!rx.demux && !analyze)
+        else if (!rx.demux && !analyze && !verify)
                 usage(argv[0]);
+
+	if (verify)
+		exit(verify_ps(rx.fd_in, rx.otype) ? 1 : 0);
 	
         if (!strncmp(inpt,"TS",3)){
 		rx.itype=REPLEX_TS;
@@ -2711,6 +3381,19 @@ int main(int argc, char **argv)
                 usage(argv[0]);
 	}
 
+	if ((checkpoint || resume) && rx.itype == REPLEX_AVI){
+		fprintf(stderr,"Checkpoints need a TS or PS input\n");
+		exit(1);
+	}
+
+	if (nprog){
+		if (rx.itype != REPLEX_TS || rx.demux || analyze){
+			fprintf(stderr,"Several programs can only be remultiplexed from a TS\n");
+			exit(1);
+		}
+		setup_programs(&rx, progs, pfiles, nprog);
+	}
+
 	init_replex(&rx, bufsize);
 	rx.analyze= analyze;
 
@@ -2782,5 +3465,6 @@ int main(int argc, char **argv)
 		do_replex(&rx);
 	}
 	
+	stats_report();
 	return 0;
 }
@@ -39,7 +39,8 @@
 
 enum { S_SEARCH, S_FOUND, S_ERROR };
 #define MIN_JUMP 100*CLOCK_MS;
-#define MAXFRAME 2000
+#define N_PROG 16
+#define PROBE_SIZE (8*TS_MAX_SIZE)   // read to find the stream type
 
 struct replex {
 #define REPLEX_TS  0
@@ -61,17 +62,24 @@ struct replex {
 	int demux;
 	int dmx_out[N_AC3+N_AUDIO+1];
 	int analyze;
+	int analyze_format;      // -Y, AN_TEXT etc.
 	avi_context ac;
 	int vdr;
 	int fillzero;
 	int overflows;
 	int max_overflows;
+	int ts_resyncs;
+	uint64_t ts_dropped;
+	int ts_stride;     // 188, 192 (M2TS) or 204 (RS parity)
+	int ts_prefix;     // bytes before the sync byte
+	ts_clock_t clock;  // recovered from the PCRs of the input
 
 	uint64_t video_delay;
 	uint64_t audio_delay;
 
 #define INDEX_BUF (32000*32)
 
+	int bufsize;   // from -g
 	int audiobuf;
 	int ac3buf;
 	int videobuf;
@@ -79,44 +87,18 @@ struct replex {
   //ac3 
 	int ac3n;
 	uint16_t ac3_id[N_AC3];
-	pes_in_t pac3[N_AC3];
-	index_unit current_ac3index[N_AC3];
-	int ac3pes_abort[N_AC3];
-	ringbuffer ac3rbuffer[N_AC3];
-	ringbuffer index_ac3rbuffer[N_AC3];
-	uint64_t ac3frame_count[N_AC3];
-	audio_frame_t ac3frame[N_AC3];
-	uint64_t first_ac3pts[N_AC3];
-	int ac3_state[N_AUDIO];
-	uint64_t last_ac3pts[N_AC3];
-	uint64_t ac3_jump[N_AUDIO];
-	uint64_t ac3pts_off[N_AC3];
-	uint8_t  ac3fillframe[N_AC3][MAXFRAME];
-	int  ac3filled[N_AC3];
-
+	audio_stream_t *ac3stream;
 
 // mpeg audio
 	int apidn;
 	uint16_t apid[N_AUDIO];
-	pes_in_t paudio[N_AUDIO];
-	index_unit current_aindex[N_AUDIO];
-	int apes_abort[N_AUDIO];
-	ringbuffer arbuffer[N_AUDIO];
-	ringbuffer index_arbuffer[N_AUDIO];
-	uint64_t aframe_count[N_AUDIO];
-	audio_frame_t aframe[N_AUDIO];
-	uint64_t first_apts[N_AUDIO];
-	int audio_state[N_AUDIO];
-	uint64_t last_apts[N_AUDIO];
-	uint64_t audio_jump[N_AUDIO];
-	uint64_t apts_off[N_AUDIO];
-	uint8_t  afillframe[N_AC3][MAXFRAME];
-	int  afilled[N_AC3];
+	audio_stream_t *astream;
 
 //mpeg video
         uint16_t vpid;
 	int first_iframe;
 	pes_in_t pvideo;
+	ts_pid_t vts;
 	index_unit current_vindex;
 	int vpes_abort;
 	ringbuffer vrbuffer;
@@ -134,6 +116,17 @@ struct replex {
 	int scan_found;
         char **inputFiles;
         int inputIdx;
+	int follow;              // seconds to wait for a growing input
+	int follow_fd;           // inotify watch on the last input file
+	int follow_closed;       // closed by its writer or timed out
+	int low_latency;         // small buffers and reads, tight SCR lead
+
+// several programs from one input
+	int program;             // PMT program number, 0 if given by PIDs
+	struct replex *next;     // the next program
+	struct replex *in;       // the program that reads the input
+	struct replex **pidmap;  // program of each PID
+	int done;                // finished, its packets are dropped
 };
 
 void init_index(index_unit *iu);
@@ -30,8 +30,12 @@
 #include <string.h>
 #include "ringbuffer.h"
 #include "pes.h"
+#include "fuzz.h"
 
 #define DEBUG 1
+
+uint64_t ring_clock = 0;
+
 // Initialize buffer
 int ring_init (ringbuffer *rbuf, int size)
 {
@@ -47,12 +51,16 @@ int ring_init (ringbuffer *rbuf, int size)
 	}
 	rbuf->read_pos = 0;	
 	rbuf->write_pos = 0;
+	rbuf->high = 0;
+	rbuf->fill_sum = 0;
+	rbuf->fill_start = rbuf->fill_since = ring_clock;
 	return 0;
 }
 
 // reset buffer
 void ring_clear(ringbuffer *rbuf)
 {
+	ring_account(rbuf);
 	rbuf->read_pos = 0;	
 	rbuf->write_pos = 0;
 }
@@ -72,6 +80,7 @@ int ring_write(ringbuffer *rbuf, uint8_t *data, int count)
 	int free, pos, rest;
 
 	if (count <=0 ) return 0;
+	FUZZ_WORK(count);
        	pos  = rbuf->write_pos;
 	rest = rbuf->size - pos;
 	free = ring_free(rbuf);
@@ -86,6 +95,7 @@ int ring_write(ringbuffer *rbuf, uint8_t *data, int count)
 		}
 	}
 	
+	ring_account(rbuf);
 	if (count >= rest){
 		memcpy (rbuf->buffer+pos, data, rest);
 		if (count - rest)
@@ -95,12 +105,56 @@ int ring_write(ringbuffer *rbuf, uint8_t *data, int count)
 		memcpy (rbuf->buffer+pos, data, count);
 		rbuf->write_pos += count;
 	}
+	ring_high(rbuf);
 
 	if (DEBUG>1) fprintf(stderr,"Buffer empty %.2f%%\n", 
 			     ring_free(rbuf)*100.0/rbuf->size);
 	return count;
 }
 
+// write several pieces of data at once
+int ring_writev(ringbuffer *rbuf, struct iovec *iov, int iovcnt)
+{
+	int i, pos, count=0;
+
+	for (i=0; i < iovcnt; i++) count += iov[i].iov_len;
+	if (count <=0 ) return 0;
+
+	if ( ring_free(rbuf) < count ){
+		int w;
+
+		count = 0;
+		for (i=0; i < iovcnt; i++){
+			if ((w = ring_write(rbuf, iov[i].iov_base, 
+					    iov[i].iov_len)) < 0)
+				return w;
+			count += w;
+		}
+		return count;
+	}
+
+	ring_account(rbuf);
+       	pos  = rbuf->write_pos;
+	for (i=0; i < iovcnt; i++){
+		int l = iov[i].iov_len;
+		int rest = rbuf->size - pos;
+
+		if (l >= rest){
+			memcpy (rbuf->buffer+pos, iov[i].iov_base, rest);
+			memcpy (rbuf->buffer, (uint8_t *)iov[i].iov_base+rest, 
+				l - rest);
+			pos = l - rest;
+		} else {
+			memcpy (rbuf->buffer+pos, iov[i].iov_base, l);
+			pos += l;
+		}
+	}
+	rbuf->write_pos = pos;
+	ring_high(rbuf);
+
+	return count;
+}
+
 // peek into buffer
 int ring_peek(ringbuffer *rbuf, uint8_t *data, int count, long off)
 {
@@ -108,6 +162,7 @@ int ring_peek(ringbuffer *rbuf, uint8_t *data, int count, long off)
 	int avail, pos, rest;
 
 	if (count <=0 || off+count > rbuf->size || off+count >ring_avail(rbuf)) return -1;
+	FUZZ_WORK(count);
 	pos  = (rbuf->read_pos+off)%rbuf->size;
 	rest = rbuf->size - pos ;
 	avail = ring_avail(rbuf); 
@@ -131,6 +186,29 @@ int ring_peek(ringbuffer *rbuf, uint8_t *data, int count, long off)
 }
 
 
+// reference data in the buffer without copying it (at most 2 iovecs)
+int ring_peek_iov(ringbuffer *rbuf, struct iovec *iov, int count, long off)
+{
+	int pos, rest;
+
+	if (count <=0 || off+count > rbuf->size || off+count >ring_avail(rbuf)) return -1;
+	pos  = (rbuf->read_pos+off)%rbuf->size;
+	rest = rbuf->size - pos ;
+
+	iov[0].iov_base = rbuf->buffer+pos;
+	if ( count < rest ){
+		iov[0].iov_len = count;
+		return 1;
+	}
+	iov[0].iov_len = rest;
+	if (!(count - rest)) return 1;
+	iov[1].iov_base = rbuf->buffer;
+	iov[1].iov_len = count - rest;
+
+	return 2;
+}
+
+
 //read from buffer
 int ring_read(ringbuffer *rbuf, uint8_t *data, int count)
 {
@@ -148,6 +226,7 @@ int ring_read(ringbuffer *rbuf, uint8_t *data, int count)
 		return EMPTY_BUFFER;
 	}
 
+	ring_account(rbuf);
 	if ( count < rest ){
 		memcpy(data, rbuf->buffer+pos, count);
 		rbuf->read_pos += count;
@@ -179,6 +258,7 @@ int ring_skip(ringbuffer *rbuf, int count)
 //			avail, count, pos, rbuf->write_pos);
 		return EMPTY_BUFFER;
 	}
+	ring_account(rbuf);
 	if ( count < rest ){
 		rbuf->read_pos += count;
 	} else {
@@ -198,6 +278,7 @@ int ring_write_file(ringbuffer *rbuf, int fd, int count)
 	int free, pos, rest, rr;
 
 	if (count <=0 ) return 0;
+	FUZZ_WORK(count);
        	pos  = rbuf->write_pos;
 	rest = rbuf->size - pos;
 	free = ring_free(rbuf);
@@ -210,6 +291,7 @@ int ring_write_file(ringbuffer *rbuf, int fd, int count)
 
 	if ( count > free ) count = free;
 	
+	ring_account(rbuf);
 	if (count >= rest){
 		rr = read (fd, rbuf->buffer+pos, rest);
 		if (rr == rest && count - rest)
@@ -221,6 +303,7 @@ int ring_write_file(ringbuffer *rbuf, int fd, int count)
 		if (rr >=0)
 			rbuf->write_pos += rr;
 	}
+	ring_high(rbuf);
 
 	if (DEBUG>1) fprintf(stderr,"Buffer empty %.2f%%\n", 
 			   ring_free(rbuf)*100.0/rbuf->size);
@@ -246,6 +329,7 @@ int ring_read_file(ringbuffer *rbuf, int fd, int count)
 		return EMPTY_BUFFER;
 	}
 
+	ring_account(rbuf);
 	if (count >= rest){
 		rr = write (fd, rbuf->buffer+pos, rest);
 		if (rr == rest && count - rest)
@@ -264,6 +348,14 @@ int ring_read_file(ringbuffer *rbuf, int fd, int count)
 	return rr;
 }
 
+// average fill so far
+int ring_avg_fill(ringbuffer *rbuf)
+{
+	ring_account(rbuf);
+	if (ring_clock == rbuf->fill_start) return ring_avail(rbuf);
+	return rbuf->fill_sum / (ring_clock - rbuf->fill_start);
+}
+
 // print memory 
 static void show(uint8_t *buf, int length)
 {
@@ -327,61 +419,93 @@ void ring_show(ringbuffer *rbuf, int count, long off)
 int dummy_init(dummy_buffer *dbuf, int s)
 {
 	dbuf->size = s;
-	dbuf->fill = 0;
-	if (ring_init(&dbuf->time_index, DBUF_INDEX*sizeof(uint64_t)) < 0)
-		return -1;
-	if (ring_init(&dbuf->data_index, DBUF_INDEX*sizeof(int32_t)) < 0)
-		return -1;
+	dbuf->high = 0;
+	dbuf->fill_sum = 0;
+	dbuf->fill_start = dbuf->fill_since = ring_clock;
+	dummy_clear(dbuf);
 
 	return 0;
 }
 
+static void dummy_account(dummy_buffer *dbuf)
+{
+	dbuf->fill_sum += (uint64_t)dbuf->fill*(ring_clock - dbuf->fill_since);
+	dbuf->fill_since = ring_clock;
+}
+
+uint32_t dummy_avg_fill(dummy_buffer *dbuf)
+{
+	dummy_account(dbuf);
+	if (ring_clock == dbuf->fill_start) return dbuf->fill;
+	return dbuf->fill_sum / (ring_clock - dbuf->fill_start);
+}
+
 void dummy_clear(dummy_buffer *dbuf)
 {
+	dummy_account(dbuf);
 	dbuf->fill = 0;
-	ring_clear(&dbuf->time_index);
-	ring_clear(&dbuf->data_index);
+	dbuf->head = 0;
+	dbuf->count = 0;
 }
 
 int dummy_add(dummy_buffer *dbuf, uint64_t time, uint32_t size)
 {
+	dummy_entry *e;
+
 	if (dummy_space(dbuf) < size) return -1;
-//	fprintf(stderr,"add %d ",dummy_space(dbuf));    
+	dummy_account(dbuf);
 	dbuf->fill += size;
-	if (ring_write(&dbuf->time_index, (uint8_t *)&time, sizeof(uint64_t)) < 0) 
-		return -2;
-	if (ring_write(&dbuf->data_index, (uint8_t *)&size, sizeof(uint32_t)) < 0) 
-		return -3;
-//	fprintf(stderr," - %d = ",size);    
-//	fprintf(stderr,"%d\n",dummy_space(dbuf));    
+	if (dbuf->fill > dbuf->high) dbuf->high = dbuf->fill;
+
+	if (dbuf->count == DBUF_INDEX){
+		/* index full, account the data to the newest entry and
+		   release it with the later of both times */
+		e = &dbuf->index[(dbuf->head + DBUF_INDEX-1) % DBUF_INDEX];
+		if (ptscmp(time, e->time) > 0) e->time = time;
+		e->size += size;
+		return size;
+	}
+
+	e = &dbuf->index[(dbuf->head + dbuf->count) % DBUF_INDEX];
+	e->time = time;
+	e->size = size;
+	dbuf->count++;
+
 	return size;
 }
 
 int dummy_delete(dummy_buffer *dbuf, uint64_t time)
 {
-	uint64_t rtime;
-	uint32_t size;
-	int ex=0;
 	uint32_t dsize=0;
 
-	do {
-		if (ring_peek(&dbuf->time_index,(uint8_t *) &rtime, 
-			      sizeof(uint64_t), 0)<0){
-			if (dsize) break;
-			else return -1;
-		}
-		if (ptscmp(rtime,time) < 0){
-			ring_read(&dbuf->time_index,(uint8_t *) &rtime, 
-				  sizeof(uint64_t));
-			ring_read(&dbuf->data_index,(uint8_t *) &size, 
-				  sizeof(uint32_t));
-			dsize += size;
-		} else ex = 1;
-	} while (!ex);
-//	fprintf(stderr,"delete %d ",dummy_space(dbuf));    
+	if (!dbuf->count) return -1;
+
+	while (dbuf->count && ptscmp(dbuf->index[dbuf->head].time, time) < 0){
+		dsize += dbuf->index[dbuf->head].size;
+		if (++dbuf->head == DBUF_INDEX) dbuf->head = 0;
+		dbuf->count--;
+	}
+	if (dsize) dummy_account(dbuf);
 	dbuf->fill -= dsize;
-//	fprintf(stderr," + %d = ",dsize);    
-//	fprintf(stderr,"%d\n",dummy_space(dbuf));    
 
 	return dsize;
 }
+
+/* the time dummy_delete() has to pass to leave more than space bytes
+   free, -1 if it never will */
+int dummy_release(dummy_buffer *dbuf, uint32_t space, uint64_t *time)
+{
+	uint32_t room = dummy_space(dbuf);
+	int i, n;
+
+	for (n = 0, i = dbuf->head; n < dbuf->count; n++){
+		dummy_entry *e = &dbuf->index[i];
+
+		if (!n || ptscmp(e->time, *time) > 0) *time = e->time;
+		room += e->size;
+		if (room > space) return 0;
+		if (++i == DBUF_INDEX) i = 0;
+	}
+
+	return -1;
+}
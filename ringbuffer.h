@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -43,16 +44,36 @@ extern "C" {
 		int write_pos;
 		int size;
 		uint8_t *buffer;
+
+		/* occupancy, weighted with ring_clock */
+		int high;
+		uint64_t fill_sum;
+		uint64_t fill_since;
+		uint64_t fill_start;
 	} ringbuffer;
 
+/* advanced by the user, e.g. by the number of bytes read, so that the
+   average fill can be weighted by progress */
+	extern uint64_t ring_clock;
+
 
 #define DBUF_INDEX 1000
 
+	typedef struct dummy_entry_s {
+		uint64_t time;
+		uint32_t size;
+	} dummy_entry;
+
 	typedef struct dummy_buffer_s {
 		uint32_t size;
 		uint32_t fill;
-		ringbuffer time_index;
-		ringbuffer data_index;
+		int head;
+		int count;
+		uint32_t high;
+		uint64_t fill_sum;
+		uint64_t fill_since;
+		uint64_t fill_start;
+		dummy_entry index[DBUF_INDEX];
 	} dummy_buffer;
 
 
@@ -60,11 +81,14 @@ extern "C" {
 	void ring_clear(ringbuffer *rbuf);
 	void ring_destroy(ringbuffer *rbuf);
 	int ring_write(ringbuffer *rbuf, uint8_t *data, int count);
+	int ring_writev(ringbuffer *rbuf, struct iovec *iov, int iovcnt);
 	int ring_read(ringbuffer *rbuf, uint8_t *data, int count);
 	int ring_write_file(ringbuffer *rbuf, int fd, int count);
 	int ring_read_file(ringbuffer *rbuf, int fd, int count);
 	int ring_peek(ringbuffer *rbuf, uint8_t *data, int count, long off);
+	int ring_peek_iov(ringbuffer *rbuf, struct iovec *iov, int count, long off);
 	int ring_skip(ringbuffer *rbuf, int count);
+	int ring_avg_fill(ringbuffer *rbuf);
 
 	static inline int ring_wpos(ringbuffer *rbuf)
 	{
@@ -108,6 +132,20 @@ extern "C" {
 		return avail;
 	}
 
+	/* called before the fill changes */
+	static inline void ring_account(ringbuffer *rbuf){
+		rbuf->fill_sum += (uint64_t)ring_avail(rbuf)*
+			(ring_clock - rbuf->fill_since);
+		rbuf->fill_since = ring_clock;
+	}
+
+	/* called after data was added */
+	static inline void ring_high(ringbuffer *rbuf){
+		int avail = ring_avail(rbuf);
+
+		if (avail > rbuf->high) rbuf->high = avail;
+	}
+
 
 
 	static inline uint32_t dummy_space(dummy_buffer *dbuf)
@@ -116,8 +154,10 @@ extern "C" {
 	}
 	int dummy_delete(dummy_buffer *dbuf, uint64_t time);
 	int dummy_add(dummy_buffer *dbuf, uint64_t time, uint32_t size);
+	int dummy_release(dummy_buffer *dbuf, uint32_t space, uint64_t *time);
 	void dummy_clear(dummy_buffer *dbuf);
 	int dummy_init(dummy_buffer *dbuf, int s);
+	uint32_t dummy_avg_fill(dummy_buffer *dbuf);
 	void ring_show(ringbuffer *rbuf, int count, long off);
 
 #ifdef __cplusplus
@@ -0,0 +1,218 @@
+/*
+ * rxbench.c: run replex in all modes and report throughput and memory
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_ARGS 64
+
+typedef struct bench_mode_s {
+	char *name;
+	char *args[4];		/* {o} is replaced by the output name */
+} bench_mode;
+
+static bench_mode modes[] = {
+	{ "DVD",     { "-t", "DVD", "-o", "{o}.mpg" } },
+	{ "MPEG2",   { "-t", "MPEG2", "-o", "{o}.mpg" } },
+	{ "demux",   { "-z", "-o", "{o}", NULL } },
+	{ "analyze", { "-y", "2", NULL, NULL } },
+	{ "scan",    { "-s", NULL, NULL, NULL } },
+	{ NULL,      { NULL } }
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/* returns the exit status, wall time and peak RSS in kB */
+static int run(char **argv, double *secs, long *rss)
+{
+	struct rusage ru;
+	double start = now();
+	int status, fd;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0){
+		perror("fork");
+		exit(1);
+	}
+	if (!pid){
+		fd = open("/dev/null", O_RDWR);
+		dup2(fd, 1);
+		dup2(fd, 2);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, &ru) < 0){
+		perror("wait4");
+		exit(1);
+	}
+	*secs = now() - start;
+	*rss = ru.ru_maxrss;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void bench_file(char *replex, char *dir, int runs, char *spec)
+{
+	char *argv[MAX_ARGS];
+	char *file, *opts, *base, *tok;
+	char out[1024];
+	struct stat st;
+	int m, i, j, argc, nopts = 0;
+	char *extra[MAX_ARGS];
+
+	file = strdup(spec);
+	opts = strchr(file, ':');
+	if (opts){
+		*opts++ = 0;
+		for (tok = strtok(opts, " "); tok && nopts < MAX_ARGS/2;
+		     tok = strtok(NULL, " "))
+			extra[nopts++] = tok;
+	}
+	if (stat(file, &st) < 0){
+		perror(file);
+		exit(1);
+	}
+	base = strrchr(file, '/');
+	base = base ? base+1 : file;
+
+	for (m = 0; modes[m].name; m++){
+		double best = 0;
+		long rss = 0;
+		int ret = 0;
+
+		snprintf(out, sizeof(out), "%s/%s.%s", dir, base,
+			 modes[m].name);
+		argc = 0;
+		argv[argc++] = replex;
+		for (i = 0; i < nopts; i++)
+			argv[argc++] = extra[i];
+		for (i = 0; i < 4 && modes[m].args[i]; i++){
+			char *a = modes[m].args[i];
+			char *o = strstr(a, "{o}");
+			if (o){
+				static char name[4][1100];
+				snprintf(name[i], sizeof(name[i]), "%s%s",
+					 out, o+3);
+				a = name[i];
+			}
+			argv[argc++] = a;
+		}
+		argv[argc++] = file;
+		argv[argc] = NULL;
+
+		for (j = 0; j < runs; j++){
+			double secs;
+			long r;
+
+			ret = run(argv, &secs, &r);
+			if (!j || secs < best) best = secs;
+			if (r > rss) rss = r;
+		}
+		printf("%-20s %-8s %8.1f MB/s %8.3f s %8ld kB",
+		       base, modes[m].name,
+		       best > 0 ? st.st_size/best/(1024*1024) : 0,
+		       best, rss);
+		if (ret) printf("  exit %d", ret);
+		printf("\n");
+		fflush(stdout);
+	}
+	free(file);
+}
+
+void usage(char *progname)
+{
+        printf ("usage: %s [options] <input file[:replex options]>...\n\n",progname);
+        printf ("options:\n");
+        printf ("  --help,             -h            :  print help message\n");
+        printf ("\n");
+        printf ("  --dir,              -d <string>   :  directory for the output files (default .)\n");
+        printf ("  --runs,             -n <integer>  :  runs per mode, the fastest is reported (default 3)\n");
+        printf ("  --replex,           -r <filename> :  replex binary (default ./replex)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char *replex = "./replex";
+	char *dir = ".";
+	int runs = 3;
+	int c;
+
+        while (1){
+                int option_index = 0;
+                static struct option long_options[] = {
+			{"dir", required_argument, NULL, 'd'},
+			{"help", no_argument , NULL, 'h'},
+			{"runs", required_argument, NULL, 'n'},
+			{"replex", required_argument, NULL, 'r'},
+			{0, 0, 0, 0}
+		};
+                c = getopt_long (argc, argv, "d:hn:r:",
+                                 long_options, &option_index);
+                if (c == -1)
+                        break;
+
+                switch (c){
+                case 'd':
+			dir = optarg;
+			break;
+                case 'n':
+			runs = strtol(optarg,(char **)NULL, 0);
+			break;
+                case 'r':
+			replex = optarg;
+			break;
+                case 'h':
+                case '?':
+                default:
+                        usage(argv[0]);
+                }
+        }
+	if (optind == argc || runs < 1) usage(argv[0]);
+
+	printf("%-20s %-8s %13s %10s %11s\n", "input", "mode",
+	       "throughput", "time", "peak RSS");
+	for (; optind < argc; optind++)
+		bench_file(replex, dir, runs, argv[optind]);
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * rxdump.c: print the pack structure of a program stream
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * One line per pack:
+ *   <pack number> <offset> scr=<27MHz> rate=<50 byte/s> <packets>
+ * and for every packet in the pack
+ *   <stream id>[.<substream id>]:<length>[ pts=<90kHz>][ dts=<90kHz>]
+ * so that two dumps can be compared with diff.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BUF_SIZE (1024*1024)
+
+static uint64_t get_ts(uint8_t *b)
+{
+	return ((uint64_t)(b[0] & 0x0E) << 29) | (b[1] << 22) |
+		((b[2] & 0xFE) << 14) | (b[3] << 7) | (b[4] >> 1);
+}
+
+static void dump_pes(uint8_t *b, int length)
+{
+	int id = b[3];
+	int plength = (b[4] << 8) | b[5];
+
+	printf(" %02x", id);
+	if (id == 0xBB || id == 0xBE || id == 0xBF || length < 9 ||
+	    (b[6] & 0xC0) != 0x80){
+		printf(":%d", plength);
+		return;
+	}
+	if (id == 0xBD && 9 + b[8] < length)
+		printf(".%02x", b[9 + b[8]]);
+	printf(":%d", plength);
+	if ((b[7] & 0x80) && length >= 14)
+		printf(" pts=%llu", (unsigned long long)get_ts(b+9));
+	if ((b[7] & 0x40) && length >= 19)
+		printf(" dts=%llu", (unsigned long long)get_ts(b+14));
+}
+
+int main(int argc, char **argv)
+{
+	FILE *f;
+	uint8_t *buf;
+	size_t have = 0, c = 0;
+	uint64_t offset = 0;
+	int npack = 0;
+	int line = 0;
+	int eof = 0;
+
+	if (argc != 2){
+		fprintf(stderr,"usage: %s <program stream>\n", argv[0]);
+		exit(1);
+	}
+	if (!(f = fopen(argv[1], "r"))){
+		perror(argv[1]);
+		exit(1);
+	}
+	if (!(buf = malloc(BUF_SIZE))){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+
+	while (1){
+		size_t n;
+
+		/* keep at least one maximum size packet in the buffer */
+		if (!eof && have - c < 0x10000 + 6){
+			memmove(buf, buf+c, have-c);
+			offset += c;
+			have -= c;
+			c = 0;
+			n = fread(buf+have, 1, BUF_SIZE-have, f);
+			if (!n) eof = 1;
+			have += n;
+		}
+		if (have - c < 4) break;
+
+		if (buf[c] || buf[c+1] || buf[c+2] != 1){
+			c++;
+			continue;
+		}
+		switch (buf[c+3]){
+		case 0xBA:
+			if (have - c < 14) goto out;
+			if ((buf[c+4] & 0xC0) == 0x40){
+				uint8_t *s = buf+c+4;
+				uint64_t base, ext;
+				int rate;
+
+				base = ((uint64_t)(s[0] & 0x38) << 27) |
+					((uint64_t)(s[0] & 0x03) << 28) |
+					(s[1] << 20) | ((s[2] & 0xF8) << 12) |
+					((s[2] & 0x03) << 13) | (s[3] << 5) |
+					(s[4] >> 3);
+				ext = ((s[4] & 0x03) << 7) | (s[5] >> 1);
+				rate = (s[6] << 14) | (s[7] << 6) | (s[8] >> 2);
+				if (line) printf("\n");
+				line = 1;
+				printf("%d %llu scr=%llu rate=%d", npack,
+				       (unsigned long long)(offset + c),
+				       (unsigned long long)(base*300 + ext),
+				       rate);
+				c += 14 + (s[9] & 0x07);
+			} else {
+				uint8_t *s = buf+c+4;
+				uint64_t base = get_ts(s);
+
+				if (line) printf("\n");
+				line = 1;
+				printf("%d %llu scr=%llu mpeg1", npack,
+				       (unsigned long long)(offset + c),
+				       (unsigned long long)(base*300));
+				c += 12;
+			}
+			npack++;
+			break;
+		case 0xB9:
+			if (line) printf("\n");
+			line = 1;
+			printf("end %llu", (unsigned long long)(offset + c));
+			c += 4;
+			break;
+		default:
+			if (buf[c+3] < 0xBB){
+				c++;
+				break;
+			}
+			if (have - c < 6) goto out;
+			{
+				int length = 6 + ((buf[c+4] << 8) | buf[c+5]);
+				if ((size_t)length > have - c)
+					length = have - c;
+				dump_pes(buf+c, length);
+				c += length;
+			}
+			break;
+		}
+	}
+out:
+	if (line) printf("\n");
+	fclose(f);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * stats.c
+ *        
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+#include "mpg_common.h"
+
+int stats_on = 0;
+
+static stage_stats stage[ST_N];
+static int cur_stage;
+static uint64_t last_switch;
+static uint64_t start_time;
+
+static const char *stage_name[ST_N] = {
+	"other", "read", "TS demux", "PES parse", "video", "audio", 
+	"mux sched", "pack build", "write"
+};
+
+static const char *unit_name[ST_N] = {
+	"", "reads", "packets", "PES", "frames", "frames", 
+	"rounds", "packs", "writes"
+};
+
+void stats_init(void)
+{
+	memset(stage, 0, sizeof(stage));
+	cur_stage = ST_OTHER;
+	start_time = last_switch = time_us();
+	stats_on = 1;
+}
+
+int stats_switch(int st)
+{
+	uint64_t now = time_us();
+	int old = cur_stage;
+
+	stage[cur_stage].time += now - last_switch;
+	last_switch = now;
+	cur_stage = st;
+	return old;
+}
+
+void stats_add(int st, uint64_t bytes, uint64_t units)
+{
+	if (!stats_on) return;
+	stage[st].bytes += bytes;
+	stage[st].units += units;
+}
+
+void stats_report(void)
+{
+	uint64_t total;
+	int i;
+
+	if (!stats_on) return;
+	stats_switch(cur_stage);
+	total = last_switch - start_time;
+	if (!total) total = 1;
+
+	fprintf(stderr,"\nstage          time s   share        MB       MB/s   units\n");
+	for (i=1; i <= ST_N; i++){
+		int s = i % ST_N;   // other comes last
+		double t = stage[s].time/1000000.;
+		double mb = stage[s].bytes/1024./1024.;
+
+		fprintf(stderr,"%-12s %8.3f  %5.1f%%  %8.2f", stage_name[s],
+			t, stage[s].time*100./total, mb);
+		if (stage[s].bytes && stage[s].time)
+			fprintf(stderr,"  %9.2f", mb/t);
+		else 
+			fprintf(stderr,"  %9s", "");
+		if (stage[s].units)
+			fprintf(stderr,"   %llu %s", 
+				(unsigned long long)stage[s].units, 
+				unit_name[s]);
+		fprintf(stderr,"\n");
+	}
+	fprintf(stderr,"total        %8.3f\n", total/1000000.);
+	if (stage[ST_READ].bytes)
+		fprintf(stderr,"throughput   %8.2f MB/s of input\n",
+			stage[ST_READ].bytes/1024./1024./(total/1000000.));
+}
@@ -0,0 +1,63 @@
+/*
+ * stats.h
+ *        
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+/* stages of the remultiplexing, time spent in nested stages is not
+   counted for the outer one */
+enum { ST_OTHER=0, ST_READ, ST_TS, ST_PES, ST_VIDEO, ST_AUDIO, 
+       ST_SCHED, ST_PACK, ST_WRITE, ST_N };
+
+typedef struct stage_stats_s{
+	uint64_t time;    // in us
+	uint64_t bytes;
+	uint64_t units;
+} stage_stats;
+
+extern int stats_on;
+
+void stats_init(void);
+int stats_switch(int stage);
+void stats_report(void);
+
+/* enter a stage and return the one to go back to */
+static inline int stats_enter(int stage)
+{
+	if (!stats_on) return ST_OTHER;
+	return stats_switch(stage);
+}
+
+static inline void stats_leave(int stage)
+{
+	if (stats_on) stats_switch(stage);
+}
+
+void stats_add(int stage, uint64_t bytes, uint64_t units);
+
+#endif /*_STATS_H_*/
@@ -77,21 +77,168 @@ int write_ts_header(uint16_t pid, uint8_t *counter, int pes_start,
 }
 
 
-int find_pids_pos(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len, int *vpos, int *apos, int *ac3pos)
+/* Check the continuity counter of tsp against the last packet of the
+   PID. Packets without payload don't increment it and a signalled
+   discontinuity starts over. */
+int ts_continuity(ts_pid_t *ts, uint8_t *tsp)
+{
+	uint8_t cc = tsp[3] & COUNT_MASK;
+
+	if (tsp[1] & TRANS_ERROR) return TS_CC_LOSS;
+	if (!ts->cc_set || !(tsp[3] & PAYLOAD)) return TS_CC_OK;
+	if ((tsp[3] & ADAPT_FIELD) && tsp[4] && (tsp[5] & DISCON_IND))
+		return TS_CC_OK;
+	if (cc == ((ts->cc+1) & COUNT_MASK)) return TS_CC_OK;
+	if (cc == ts->cc) return TS_CC_DUP;
+
+	return TS_CC_LOSS;
+}
+
+// same as ts_continuity, but the packet is counted for the PID
+int ts_count_packet(ts_pid_t *ts, uint8_t *tsp)
+{
+	int r = ts_continuity(ts, tsp);
+
+	ts->packets++;
+	if (tsp[1] & TRANS_ERROR){
+		ts->trans_errors++;
+		ts->cc_set = 0;
+		return r;
+	}
+	if (r == TS_CC_LOSS) ts->cc_errors++;
+	if (tsp[3] & PAYLOAD){
+		ts->cc = tsp[3] & COUNT_MASK;
+		ts->cc_set = 1;
+	}
+	return r;
+}
+
+// PCR of tsp in 27 MHz units, returns 0 if the packet carries none
+int ts_get_pcr(uint8_t *tsp, uint64_t *pcr)
+{
+	uint64_t base;
+
+	if (!(tsp[3] & ADAPT_FIELD) || tsp[4] < 7 || !(tsp[5] & PCR_FLAG))
+		return 0;
+
+	base = ((uint64_t)tsp[6] << 25) | (tsp[7] << 17) | (tsp[8] << 9) |
+		(tsp[9] << 1) | (tsp[10] >> 7);
+	*pcr = base*300ULL + (((tsp[10] & 0x01) << 8) | tsp[11]);
+	return 1;
+}
+
+/* Feed the PCR of tsp (if any) to the clock. A signalled discontinuity
+   or a step backwards or by more than TS_PCR_MAX_GAP starts a new time
+   base and returns TS_PCR_DISCON. */
+int ts_clock_update(ts_clock_t *clk, uint8_t *tsp)
+{
+	uint64_t pcr;
+	uint64_t d;
+	int r = TS_PCR_OK;
+
+	if (!ts_get_pcr(tsp, &pcr)) return TS_PCR_NONE;
+
+	if (!clk->set){
+		clk->pid = get_pid(tsp+1);
+		clk->set = 1;
+	} else {
+		d = (pcr + TS_PCR_WRAP - clk->pcr) % TS_PCR_WRAP;
+		if ((tsp[5] & DISCON_IND) || d > TS_PCR_MAX_GAP){
+			clk->discons++;
+			clk->discon_pcr = pcr;
+			r = TS_PCR_DISCON;
+		}
+	}
+	clk->pcr = pcr;
+	clk->count++;
+	return r;
+}
+
+/* offset of the first packet in buf that does not start with a sync
+   byte, packets are stride bytes apart */
+int ts_check_sync(uint8_t *buf, int len, int stride)
+{
+	int c;
+
+	for (c=0; c+TS_SIZE <= len; c+=stride)
+		if (buf[c] != TS_SYNC) break;
+	return c;
+}
+
+/* offset of the next sync byte that is followed by another one a packet
+   later, -1 if there is none, TS_MORE if the next one is in the last
+   stride bytes of buf and can only be checked after the next read */
+int ts_find_sync(uint8_t *buf, int len, int stride)
+{
+	uint8_t *p = buf;
+	uint8_t *q;
+
+	while (p < buf+len && (q = memchr(p, TS_SYNC, buf+len-p))){
+		int c = q-buf;
+
+		if (c+stride >= len) return TS_MORE;
+		if (buf[c+stride] == TS_SYNC) return c;
+		p = q+1;
+	}
+	return -1;
+}
+
+/* number of sync bytes in a row from c on, stride bytes apart */
+static int sync_run(uint8_t *buf, int len, int c, int stride)
+{
+	int n = 0;
+
+	for (; c < len && buf[c] == TS_SYNC; c += stride) n++;
+	return n;
+}
+
+/* Packet size of the TS in buf: plain 188 byte packets, 192 byte M2TS
+   packets with a 4 byte timestamp in front or 204 byte packets with RS
+   parity. Sync bytes also turn up in the payload, the timestamps and
+   the parity, so a size needs TS_SYNCS of them in a row, and if more
+   than one does, the longest run wins. prefix is set to the number of
+   bytes before the sync byte, start to the offset of the first complete
+   packet. Returns 0 if buf doesn't look like a TS. */
+int ts_stride(uint8_t *buf, int len, int *prefix, int *start)
+{
+	static const int sizes[] = { TS_SIZE, TS_M2TS_SIZE, TS_RS_SIZE };
+	int stride = 0;
+	int best = TS_SYNCS-1;
+	int i, c;
+
+	*prefix = 0;
+	*start = 0;
+	for (i = 0; i < 3; i++){
+		int pf = TS_PREFIX(sizes[i]);
+
+		for (c = pf; c < pf+sizes[i] && c < len; c++){
+			int n = sync_run(buf, len, c, sizes[i]);
+
+			if (n > best){
+				best = n;
+				stride = sizes[i];
+				*prefix = pf;
+				*start = c-pf;
+			}
+		}
+	}
+	return stride;
+}
+
+int find_pids_pos(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len, int stride, int *vpos, int *apos, int *ac3pos)
 {
 	int c=0;
 	int found=0;
+	int pf = TS_PREFIX(stride);
 
-	if (!vpid || !apid || !ac3pid || !buf || !len) return 0;
+	if (!vpid || !apid || !ac3pid || !buf || len <= pf) return 0;
 
 	*vpid = 0;
 	*apid = 0;
 	*ac3pid = 0;
 
-	while ( c+TS_SIZE < len){
-		if (buf[c] == buf[c+TS_SIZE]) break;
-		c++;
-	}
+	if (pf && buf[pf] == TS_SYNC) c = pf;
+	else if ((c = ts_find_sync(buf, len, stride)) < 0) return 0;
 
 	while(found<2 && c < len){
 		if (buf[c+1] & PAY_START) {
@@ -141,13 +288,110 @@ int find_pids_pos(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf,
 				}
 			}
 		} 
-		c+= TS_SIZE;
+		c+= stride;
 	}
 	return found;
 }
 
 
-int find_pids(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len)
+int find_pids(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len, int stride)
+{
+	return find_pids_pos(vpid, apid, ac3pid, buf, len, stride, 
+			     NULL, NULL, NULL);
+}
+
+
+/* The PSI section of pid starting in the packet at tsp, if it is
+   complete within that packet */
+static uint8_t *ts_section(uint8_t *tsp, uint16_t pid, int *slen)
+{
+	int off = 4;
+	uint8_t *sec;
+
+	if (get_pid(tsp+1) != pid || !(tsp[1] & PAY_START) || 
+	    (tsp[1] & TRANS_ERROR)) return NULL;
+	if (tsp[3] & ADAPT_FIELD) off += tsp[4] + 1;
+	if (off >= TS_SIZE) return NULL;
+	off += tsp[off] + 1;    // pointer field
+	if (off + 3 > TS_SIZE) return NULL;
+
+	sec = tsp+off;
+	*slen = (((sec[1] & 0x0F) << 8) | sec[2]) + 3;
+	if (off + *slen > TS_SIZE || *slen < 12) return NULL;
+	return sec;
+}
+
+// PID of the PMT of program prog in the PAT, 0 if there is none in buf
+uint16_t find_pmt_pid(uint16_t prog, uint8_t *buf, int len, int stride)
 {
-	return find_pids_pos(vpid, apid, ac3pid, buf, len, NULL, NULL, NULL);
+	int c;
+
+	for (c = TS_PREFIX(stride); c+TS_SIZE <= len; c += stride){
+		uint8_t *sec;
+		int slen, i;
+
+		if (buf[c] != TS_SYNC || !(sec = ts_section(buf+c, 0, &slen))
+		    || sec[0] != 0x00) continue;
+
+		for (i = 8; i+4 <= slen-4; i += 4)
+			if (((sec[i] << 8) | sec[i+1]) == prog)
+				return get_pid(sec+i+2);
+	}
+	return 0;
+}
+
+static int add_pid(uint16_t *pids, int *n, int max, uint16_t pid)
+{
+	if (*n == max) return 0;
+	pids[(*n)++] = pid;
+	return 1;
+}
+
+/* Streams of a program from its PMT on pid. Returns 1 if the PMT was
+   found in buf. */
+int find_pmt_pids(uint16_t pid, uint8_t *buf, int len, int stride,
+		  uint16_t *vpid, uint16_t *apid, int *apidn, int maxa, 
+		  uint16_t *ac3pid, int *ac3n, int maxac3)
+{
+	int c;
+
+	for (c = TS_PREFIX(stride); c+TS_SIZE <= len; c += stride){
+		uint8_t *sec;
+		int slen, i;
+
+		if (buf[c] != TS_SYNC || !(sec = ts_section(buf+c, pid, &slen))
+		    || sec[0] != 0x02) continue;
+
+		i = 12 + (((sec[10] & 0x0F) << 8) | sec[11]);
+		while (i+5 <= slen-4){
+			uint16_t epid = get_pid(sec+i+1);
+			int elen = ((sec[i+3] & 0x0F) << 8) | sec[i+4];
+			int d;
+
+			switch (sec[i]){
+			case 0x01:
+			case 0x02:
+				if (!*vpid) *vpid = epid;
+				break;
+			case 0x03:
+			case 0x04:
+				add_pid(apid, apidn, maxa, epid);
+				break;
+			case 0x81:
+				add_pid(ac3pid, ac3n, maxac3, epid);
+				break;
+			case 0x06:   // private data, AC3 if it has an AC3 descriptor
+				for (d = i+5; d+2 <= i+5+elen && d+2 <= slen-4;
+				     d += 2+sec[d+1])
+					if (sec[d] == 0x6A){
+						add_pid(ac3pid, ac3n, maxac3, epid);
+						break;
+					}
+				break;
+			}
+			i += 5+elen;
+		}
+		return 1;
+	}
+	return 0;
 }
@@ -29,6 +29,13 @@
 #define _TS_H_
 
 #define TS_SIZE        188
+#define TS_M2TS_SIZE   192   // 4 byte timestamp before each packet
+#define TS_RS_SIZE     204   // 16 bytes Reed-Solomon parity after each packet
+#define TS_MAX_SIZE    TS_RS_SIZE
+#define TS_PREFIX(s)   ((s) == TS_M2TS_SIZE ? 4 : 0)
+#define TS_SYNC        0x47
+#define TS_SYNCS       5     // sync bytes in a row that confirm a packet size
+#define TS_MORE        -2    // ts_find_sync() needs more data
 #define TRANS_ERROR    0x80
 #define PAY_START      0x40
 #define TRANS_PRIO     0x20
@@ -56,7 +63,48 @@
 #define PIECE_RATE     0x40
 #define SEAM_SPLICE    0x20
 
+// continuity of one PID
+typedef struct ts_pid_s{
+	uint8_t  cc;
+	uint8_t  cc_set;
+	uint8_t  lost;
+	uint64_t packets;
+	uint32_t cc_errors;
+	uint32_t trans_errors;
+} ts_pid_t;
+
+#define TS_CC_OK    0
+#define TS_CC_DUP   1
+#define TS_CC_LOSS -1
+
+// input clock recovered from the PCRs of one PID
+typedef struct ts_clock_s{
+	uint16_t pid;
+	uint8_t  set;
+	uint64_t pcr;        // last PCR in 27 MHz units
+	uint64_t count;
+	uint32_t discons;    // clock discontinuities so far
+	uint64_t discon_pcr; // first PCR of the current time base
+} ts_clock_t;
+
+#define TS_PCR_NONE    0
+#define TS_PCR_OK      1
+#define TS_PCR_DISCON  2
+#define TS_PCR_MAX_GAP 27000000ULL  // larger steps are discontinuities
+#define TS_PCR_WRAP    (300ULL << 33)
+
 uint16_t get_pid(uint8_t *pid);
-int find_pids(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len);
-int find_pids_pos(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len, int *vpos, int *apos, int *ac3pos);
+int ts_continuity(ts_pid_t *ts, uint8_t *tsp);
+int ts_count_packet(ts_pid_t *ts, uint8_t *tsp);
+int ts_get_pcr(uint8_t *tsp, uint64_t *pcr);
+int ts_clock_update(ts_clock_t *clk, uint8_t *tsp);
+int ts_check_sync(uint8_t *buf, int len, int stride);
+int ts_find_sync(uint8_t *buf, int len, int stride);
+int ts_stride(uint8_t *buf, int len, int *prefix, int *start);
+int find_pids(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len, int stride);
+int find_pids_pos(uint16_t *vpid, uint16_t *apid, uint16_t *ac3pid,uint8_t *buf, int len, int stride, int *vpos, int *apos, int *ac3pos);
+uint16_t find_pmt_pid(uint16_t prog, uint8_t *buf, int len, int stride);
+int find_pmt_pids(uint16_t pid, uint8_t *buf, int len, int stride,
+		  uint16_t *vpid, uint16_t *apid, int *apidn, int maxa, 
+		  uint16_t *ac3pid, int *ac3n, int maxac3);
 #endif /*_TS_H_*/
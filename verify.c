@@ -0,0 +1,730 @@
+/*
+ * verify.c: check a program stream against the P-STD and DVD rules
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*
+ * The stream is parsed on its own, without the demultiplexer of
+ * replex: pack headers, the system header, NAV packs and PES headers.
+ * The access units are found in the payload (picture start codes,
+ * MPEG audio and AC3 frames) and get the decode time of their PES or
+ * follow the one before by the frame period. Every byte enters the
+ * P-STD buffer of its stream at the SCR of its pack and leaves it at
+ * the decode time of its unit, counted with a dummy_buffer like the
+ * multiplexer does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "verify.h"
+#include "multiplex.h"
+#include "element.h"
+#include "pes.h"
+
+#define V_BUF     (1024*1024)
+#define V_KEEP    (MAX_PLENGTH+6)  // a whole PES packet stays in the buffer
+#define V_STREAMS 64
+#define V_REPORT  10               // problems of a kind that are printed
+#define V_SEC     27000000ULL
+#define V_NAVPCI  0x3D4
+#define V_NAVDSI  0x3FA
+
+enum { V_SYNC=0, V_SCR, V_SCRSTILL, V_RATE, V_MUXRATE, V_PACK, V_NAV,
+       V_PTS, V_LATE, V_OVERFLOW, V_KINDS };
+
+static const char *v_name[V_KINDS] = {
+	"broken stream", "SCR back", "SCR stuck", "mux rate exceeded",
+	"wrong mux rate", "wrong pack", "NAV pack", "PTS before SCR",
+	"late data", "buffer overflow"
+};
+
+enum { VS_OTHER=0, VS_VIDEO, VS_MPA, VS_AC3 };
+
+typedef struct v_stream_s{
+	int id;                 // private stream 1 as 0x100 + substream id
+	int type;
+	uint32_t size;          // P-STD buffer size, 0 for unknown
+	dummy_buffer dbuf;
+	uint64_t packets;
+	uint64_t over_pack;     // last pack with an overflow reported, +1
+
+	int have_au;
+	uint64_t au_time;       // decode time of the unit being received
+	uint64_t period;        // of one unit
+	int ts_valid;           // PES time stamp for the first unit in it
+	uint64_t ts;
+	int late;               // the unit was reported late
+
+	// video
+	uint32_t code;          // last bytes of the payload before
+	int prefix;             // payload before ended with 00 00 01
+	int seq;                // byte of the frame rate in the next payload
+
+	// audio
+	uint32_t left;          // bytes of the frame still to come
+	uint8_t hdr[8];
+	int hlen;
+	uint64_t hpacket;       // packet the header started in
+} v_stream;
+
+static const uint64_t frame_periods[16] = {
+	0, 1126125, 1125000, 1080000, 900900, 900000, 540000, 450450, 450000
+};
+
+static v_stream *streams[V_STREAMS];
+static int nstreams;
+static uint64_t count[V_KINDS];
+static multiplex_t mx;
+static int dvd;
+
+static uint64_t npack;
+static uint64_t offset;         // of what is parsed
+static uint64_t pack_off;       // of the current pack
+static uint64_t scr;
+static uint64_t last_scr;
+static uint32_t mux_rate;       // of the current pack in 50 byte/s
+static uint32_t rate_bound;
+static int nav_pending;         // NAV pack seen since the last GOP
+
+static char *tstr(uint64_t t, char *b)
+{
+	unsigned int s, ms;
+
+	t = (t/300) & (MAX_PTS-1);
+	s = t/90000;
+	ms = (t/90)%1000;
+	sprintf(b, "%d:%02d:%02d.%03d", s/3600, (s%3600)/60, s%60, ms);
+	return b;
+}
+
+static char *sname(v_stream *s, char *b)
+{
+	if (s->id > 0xFF) sprintf(b, "bd.%02x", s->id & 0xFF);
+	else sprintf(b, "%02x", s->id);
+	return b;
+}
+
+static void flag(int kind, const char *fmt, ...)
+{
+	va_list ap;
+	char t[32];
+
+	if (++count[kind] > V_REPORT){
+		if (count[kind] == V_REPORT+1)
+			printf("%s: more of these are only counted\n",
+			       v_name[kind]);
+		return;
+	}
+	printf("%s: pack %llu at %llu SCR %s: ", v_name[kind],
+	       (unsigned long long)npack, (unsigned long long)offset,
+	       tstr(scr, t));
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+}
+
+static v_stream *get_stream(int id)
+{
+	v_stream *s;
+	int i;
+
+	for (i = 0; i < nstreams; i++)
+		if (streams[i]->id == id) return streams[i];
+	if (nstreams == V_STREAMS) return NULL;
+	if (!(s = calloc(1, sizeof(v_stream)))){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+	s->id = id;
+	if (id >= VIDEO_STREAM_S && id <= VIDEO_STREAM_E){
+		s->type = VS_VIDEO;
+		s->size = mx.video_buffer_size;
+		s->period = frame_periods[3];
+	} else if (id >= AUDIO_STREAM_S && id <= AUDIO_STREAM_E){
+		s->type = VS_MPA;
+		s->size = mx.audio_buffer_size;
+	} else if (id >= 0x180 && id <= 0x187){
+		s->type = VS_AC3;
+		s->size = mx.audio_buffer_size;
+	}
+	// the size is checked here, not by the dummy_buffer
+	dummy_init(&s->dbuf, 0x7FFFFFFF);
+	streams[nstreams++] = s;
+	return s;
+}
+
+static void add_bytes(v_stream *s, uint32_t n)
+{
+	char b[2][32];
+
+	if (!n || !s->have_au) return;
+	if (!s->late && ptscmp(s->au_time, scr) < 0){
+		flag(V_LATE, "stream %s: unit for %s arrives after it",
+		     sname(s, b[0]), tstr(s->au_time, b[1]));
+		s->late = 1;
+	}
+	dummy_add(&s->dbuf, s->au_time, n);
+	if (s->size && s->dbuf.fill > s->size && s->over_pack != npack+1){
+		flag(V_OVERFLOW, "stream %s: %uK in a buffer of %uK",
+		     sname(s, b[0]), s->dbuf.fill/1024, s->size/1024);
+		s->over_pack = npack+1;
+	}
+}
+
+// a unit starts, here if it starts in the current packet
+static void new_au(v_stream *s, int here)
+{
+	if (here && s->ts_valid){
+		s->au_time = s->ts;
+		s->ts_valid = 0;
+	} else if (s->have_au){
+		ptsinc(&s->au_time, s->period);
+	} else return;       // nothing before the first time stamp
+	s->have_au = 1;
+	s->late = 0;
+}
+
+static void video_code(v_stream *s, uint8_t *b, int len, int pos, int *from)
+{
+	int start = pos >= 3 ? pos-3 : 0;
+	char n[16];
+
+	switch (b[pos]){
+	case 0x00:      // picture
+		add_bytes(s, start - *from);
+		*from = start;
+		new_au(s, 1);
+		break;
+
+	case SEQUENCE_HDR_CODE:
+		if (pos+4 < len){
+			if (frame_periods[b[pos+4] & 0x0F])
+				s->period = frame_periods[b[pos+4] & 0x0F];
+		} else s->seq = pos+4 - len + 1;
+		break;
+
+	case GROUP_START_CODE:
+		if (dvd && !nav_pending && s == streams[0])
+			flag(V_NAV, "GOP of stream %s without a NAV pack",
+			     sname(s, n));
+		nav_pending = 0;
+		break;
+	}
+}
+
+static void video_payload(v_stream *s, uint8_t *b, int len)
+{
+	int i = 0;
+	int from = 0;
+	int k;
+
+	if (s->seq){
+		if (s->seq <= len && frame_periods[b[s->seq-1] & 0x0F])
+			s->period = frame_periods[b[s->seq-1] & 0x0F];
+		s->seq = 0;
+	}
+	if (s->prefix && len){
+		s->prefix = 0;
+		video_code(s, b, len, 0, &from);
+		i = 1;
+	}
+	while (i < len){
+		uint8_t *p = memchr(b+i, 1, len-i);
+		int j;
+
+		if (!p) break;
+		j = p - b;
+		i = j+1;
+		if (j >= 2 ? (b[j-1] || b[j-2]) :
+		    j == 1 ? (b[0] || (s->code & 0xFF)) :
+		    (s->code & 0xFFFF) != 0) continue;
+		if (j+1 == len){
+			s->prefix = 1;
+			break;
+		}
+		video_code(s, b, len, j+1, &from);
+		i = j+2;
+	}
+	for (k = len > 3 ? len-3 : 0; k < len; k++)
+		s->code = (s->code << 8) | b[k];
+	add_bytes(s, len - from);
+}
+
+static int mpa_frame(uint8_t *h, uint64_t *dur)
+{
+	int lsf, mpg25, layer, br, sr, pad;
+	int len, samples;
+
+	if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return -1;
+	layer = 4 - ((h[1] >> 1) & 3);
+	lsf = !(h[1] & 0x08);
+	mpg25 = !(h[1] & 0x10);
+	br = h[2] >> 4;
+	sr = (h[2] >> 2) & 3;
+	pad = (h[2] >> 1) & 1;
+	if (layer == 4 || (mpg25 && !lsf) || !br || br == 15 || sr == 3)
+		return -1;
+	br = bitrates[lsf][layer-1][br];
+	sr = freqs[sr] >> (lsf + mpg25);
+
+	switch (layer){
+	case 1:
+		len = (12000*br/sr + pad)*4;
+		samples = 384;
+		break;
+	case 2:
+		len = 144000*br/sr + pad;
+		samples = 1152;
+		break;
+	default:
+		len = 144000*br/(sr << lsf) + pad;
+		samples = lsf ? 576 : 1152;
+		break;
+	}
+	*dur = V_SEC*samples/sr;
+	return len;
+}
+
+static int ac3_frame(uint8_t *h, uint64_t *dur)
+{
+	int fr = h[4] >> 6;
+	int code = h[4] & 0x3F;
+	int br;
+
+	if (h[0] != 0x0B || h[1] != 0x77 || fr == 3 ||
+	    !ac3_bitrates[code >> 1])
+		return -1;
+	br = ac3_bitrates[code >> 1];
+	*dur = V_SEC*1536/(ac3_freq[fr]*100);
+	switch (fr){
+	case 0:
+		return 4*br;
+	case 1:
+		return 2*(320*br/147 + (code & 1));
+	default:
+		return 6*br;
+	}
+}
+
+static void audio_payload(v_stream *s, uint8_t *b, int len)
+{
+	int need = s->type == VS_MPA ? 4 : 5;
+	uint8_t sync = s->type == VS_MPA ? 0xFF : 0x0B;
+	int i = 0;
+
+	while (i < len){
+		uint64_t dur;
+		int l;
+
+		if (s->left){
+			uint32_t k = len-i < (int)s->left ? (uint32_t)(len-i) :
+				s->left;
+
+			add_bytes(s, k);
+			s->left -= k;
+			i += k;
+			continue;
+		}
+
+		// the header of a frame may be split between two packets
+		if (!s->hlen){
+			uint8_t *p = memchr(b+i, sync, len-i);
+
+			if (!p) break;
+			i = p - b;
+			s->hpacket = s->packets;
+		}
+		s->hdr[s->hlen++] = b[i++];
+		if (s->hlen < need) continue;
+
+		l = s->type == VS_MPA ? mpa_frame(s->hdr, &dur) :
+			ac3_frame(s->hdr, &dur);
+		if (l < need){
+			// no frame, look for the next sync
+			while (--s->hlen && s->hdr[1] != sync)
+				memmove(s->hdr, s->hdr+1, s->hlen);
+			if (s->hlen) memmove(s->hdr, s->hdr+1, s->hlen);
+			continue;
+		}
+		s->period = dur;
+		new_au(s, s->hpacket == s->packets);
+		add_bytes(s, s->hlen);
+		s->left = l - s->hlen;
+		s->hlen = 0;
+	}
+}
+
+static void other_payload(v_stream *s, int len)
+{
+	new_au(s, 1);
+	add_bytes(s, len);
+}
+
+// the PES packet at b of length bytes, which are all in the buffer
+static void verify_pes(uint8_t *b, int length)
+{
+	int id = b[3];
+	int pos;
+	int flags = 0;
+	uint64_t pts = 0, dts = 0;
+	uint32_t pstd = 0;
+	v_stream *s;
+	char n[2][32];
+
+	switch (id){
+	case PROG_STREAM_MAP:
+	case PADDING_STREAM:
+	case PRIVATE_STREAM2:
+	case ECM_STREAM:
+	case EMM_STREAM:
+	case PROG_STREAM_DIR:
+	case DSM_CC_STREAM:
+		return;
+	}
+
+	if ((b[6] & 0xC0) == 0x80){
+		int f = b[7];
+
+		pos = 9;
+		if (length < 9 || 9 + b[8] > length){
+			flag(V_SYNC, "PES header of stream %02x too long", id);
+			return;
+		}
+		if ((f & PTS_DTS_FLAGS) == PTS_ONLY){
+			pts = trans_pts_dts(b+pos);
+			flags = PTS_ONLY;
+			pos += 5;
+		} else if ((f & PTS_DTS_FLAGS) == PTS_DTS){
+			pts = trans_pts_dts(b+pos);
+			dts = trans_pts_dts(b+pos+5);
+			flags = PTS_DTS;
+			pos += 10;
+		}
+		if (f & ESCR_FLAG) pos += 6;
+		if (f & ES_RATE_FLAG) pos += 3;
+		if (f & DSM_TRICK_FLAG) pos++;
+		if (f & ADD_CPY_FLAG) pos++;
+		if (f & PES_CRC_FLAG) pos += 2;
+		if ((f & PES_EXT_FLAG) && pos < 9 + b[8]){
+			int ext = b[pos++];
+
+			if (ext & 0x80) pos += 16;
+			if ((ext & 0x40) && pos < 9 + b[8]) pos += 1 + b[pos];
+			if (ext & 0x20) pos += 2;
+			if ((ext & 0x10) && pos+1 < 9 + b[8])
+				pstd = (((b[pos] & 0x1F) << 8) | b[pos+1]) *
+					(b[pos] & 0x20 ? 1024 : 128);
+		}
+		pos = 9 + b[8];
+	} else {
+		// MPEG-1
+		pos = 6;
+		while (pos < length && b[pos] == 0xFF && pos < 6+16) pos++;
+		if (pos+1 < length && (b[pos] & 0xC0) == 0x40){
+			pstd = (((b[pos] & 0x1F) << 8) | b[pos+1]) *
+				(b[pos] & 0x20 ? 1024 : 128);
+			pos += 2;
+		}
+		if (pos+5 <= length && (b[pos] & 0xF0) == 0x20){
+			pts = trans_pts_dts(b+pos);
+			flags = PTS_ONLY;
+			pos += 5;
+		} else if (pos+10 <= length && (b[pos] & 0xF0) == 0x30){
+			pts = trans_pts_dts(b+pos);
+			dts = trans_pts_dts(b+pos+5);
+			flags = PTS_DTS;
+			pos += 10;
+		} else pos++;
+		if (pos > length){
+			flag(V_SYNC, "PES header of stream %02x too long", id);
+			return;
+		}
+	}
+
+	if (id == PRIVATE_STREAM1){
+		int sub;
+
+		if (pos >= length) return;
+		sub = b[pos];
+		id = 0x100 | sub;
+		if (sub >= 0x80 && sub <= 0x8F) pos += 4;
+		else if (sub >= 0xA0 && sub <= 0xA7) pos += 7;
+		else pos++;
+		if (pos > length) pos = length;
+	}
+	if (!(s = get_stream(id))) return;
+	s->packets++;
+	if (pstd) s->size = pstd;
+
+	if (flags){
+		uint64_t t = flags == PTS_DTS ? dts : pts;
+
+		if (ptscmp(t, scr) < 0)
+			flag(V_PTS, "stream %s: %s %s", sname(s, n[0]),
+			     flags == PTS_DTS ? "DTS" : "PTS", tstr(t, n[1]));
+		s->ts = t;
+		s->ts_valid = 1;
+	} else s->ts_valid = 0;
+
+	dummy_delete(&s->dbuf, scr);
+	switch (s->type){
+	case VS_VIDEO:
+		video_payload(s, b+pos, length-pos);
+		break;
+	case VS_MPA:
+	case VS_AC3:
+		audio_payload(s, b+pos, length-pos);
+		break;
+	default:
+		other_payload(s, length-pos);
+		break;
+	}
+}
+
+static int read_all(int fd, uint8_t *buf, int l)
+{
+	int c = 0;
+
+	while (c < l){
+		int r = read(fd, buf+c, l-c);
+
+		if (r < 0){
+			if (errno == EINTR) continue;
+			perror("Error reading input");
+			exit(1);
+		}
+		if (!r) break;
+		c += r;
+	}
+	return c;
+}
+
+static void end_pack(void)
+{
+	if (dvd && npack && offset - pack_off != (uint64_t)mx.pack_size)
+		flag(V_PACK, "pack at %llu has %llu bytes",
+		     (unsigned long long)pack_off,
+		     (unsigned long long)(offset - pack_off));
+}
+
+/* Returns the length of the pack header at b, or -1 if it is not
+   complete in the have bytes. */
+static int verify_pack(uint8_t *b, int have)
+{
+	uint8_t *s = b+4;
+	uint64_t bytes = offset - pack_off;
+	uint32_t rate;
+	int l;
+	char t[32];
+
+	if (have < 14) return -1;
+	if ((s[0] & 0xC0) == 0x40){
+		uint64_t base = ((uint64_t)(s[0] & 0x38) << 27) |
+			((uint64_t)(s[0] & 0x03) << 28) |
+			(s[1] << 20) | ((s[2] & 0xF8) << 12) |
+			((s[2] & 0x03) << 13) | (s[3] << 5) | (s[4] >> 3);
+
+		scr = base*300 + (((s[4] & 0x03) << 7) | (s[5] >> 1));
+		rate = (s[6] << 14) | (s[7] << 6) | (s[8] >> 2);
+		l = 14 + (s[9] & 0x07);
+	} else {
+		scr = trans_pts_dts(s);
+		rate = ((s[5] & 0x7F) << 15) | (s[6] << 7) | (s[7] >> 1);
+		l = 12;
+		if (dvd) flag(V_PACK, "MPEG-1 pack header");
+	}
+	if (have < l) return -1;
+
+	if (npack){
+		end_pack();
+		if (ptscmp(scr, last_scr) < 0)
+			flag(V_SCR, "SCR went backwards from %s",
+			     tstr(last_scr, t));
+		else if (scr == last_scr)
+			flag(V_SCRSTILL, "SCR did not advance from %s",
+			     tstr(last_scr, t));
+		else if (mux_rate &&
+			 (ptsdiff(scr, last_scr) + 300) * mux_rate * 50 <
+			 bytes * V_SEC)
+			flag(V_RATE, "%llu bytes in %.3f ms",
+			     (unsigned long long)bytes,
+			     ptsdiff(scr, last_scr)/27000.);
+	}
+	if (dvd && mx.mux_rate && rate != mx.mux_rate/50)
+		flag(V_MUXRATE, "%u instead of %u", rate*50, mx.mux_rate);
+	if (rate_bound && rate > rate_bound)
+		flag(V_MUXRATE, "%u above the rate bound %u", rate*50,
+		     rate_bound*50);
+
+	// a NAV pack: system header, PCI and DSI
+	if (dvd){
+		uint8_t *p = b+l;
+		int nav = 0;
+
+		if (have >= l+6 && !p[0] && !p[1] && p[2] == 1 &&
+		    p[3] == SYS_START){
+			int sl = 6 + ((p[4] << 8) | p[5]);
+
+			p += sl;
+			if (have >= l+sl+12 && p[3] == PRIVATE_STREAM2 &&
+			    ((p[4] << 8) | p[5]) == V_NAVPCI){
+				p += 6 + V_NAVPCI;
+				if (have >= l+sl+12+V_NAVPCI &&
+				    p[3] == PRIVATE_STREAM2 &&
+				    ((p[4] << 8) | p[5]) == V_NAVDSI)
+					nav = 1;
+			}
+			if (!nav)
+				flag(V_NAV, "system header without PCI and DSI");
+		}
+		if (nav) nav_pending = 1;
+		else if (!npack) flag(V_NAV, "the first pack is no NAV pack");
+	}
+
+	pack_off = offset;
+	last_scr = scr;
+	mux_rate = rate;
+	npack++;
+	return l;
+}
+
+static void verify_system(uint8_t *b)
+{
+	rate_bound = ((b[6] & 0x7F) << 15) | (b[7] << 7) | (b[8] >> 1);
+}
+
+long verify_ps(int fd, int otype)
+{
+	uint8_t *buf;
+	sequence_t seq;
+	size_t have = 0, c = 0;
+	int eof = 0;
+	int lost = 0;
+	long problems = 0;
+	int i;
+
+	memset(&mx, 0, sizeof(mx));
+	memset(&seq, 0, sizeof(seq));
+	mux_limits(&mx, &seq, NULL, NULL, 0, 0, otype, 0);
+	dvd = mx.navpack;
+	if (!(buf = malloc(V_BUF))){
+		fprintf(stderr,"Not enough memory\n");
+		exit(1);
+	}
+
+	while (1){
+		uint8_t *b;
+
+		if (!eof && have - c < V_KEEP){
+			int n;
+
+			memmove(buf, buf+c, have-c);
+			have -= c;
+			c = 0;
+			n = read_all(fd, buf+have, V_BUF-have);
+			if (!n) eof = 1;
+			have += n;
+		}
+		if (have - c < 4) break;
+		b = buf+c;
+
+		if (b[0] || b[1] || b[2] != 1 || b[3] < SYSTEM_START_CODE_S){
+			uint8_t *p;
+
+			if (!lost){
+				flag(V_SYNC, "no start code");
+				lost = 1;
+			}
+			p = memchr(b+1, 0, have-c-1);
+			offset += p ? (size_t)(p - b) : have-c;
+			c = p ? (size_t)(p - buf) : have;
+			continue;
+		}
+		lost = 0;
+
+		switch (b[3]){
+		case PACK_START:{
+			int l = verify_pack(b, have-c);
+
+			if (l < 0) goto out;
+			c += l;
+			offset += l;
+			break;
+		}
+		case SYSTEM_START_CODE_S:      // program end code
+			end_pack();
+			pack_off = offset + 4;
+			c += 4;
+			offset += 4;
+			break;
+		default:{
+			int l;
+
+			if (have - c < 6) goto out;
+			l = 6 + ((b[4] << 8) | b[5]);
+			if ((size_t)l > have - c){
+				flag(V_SYNC, "PES of stream %02x cut off", b[3]);
+				goto out;
+			}
+			if (b[3] == SYS_START) verify_system(b);
+			else verify_pes(b, l);
+			c += l;
+			offset += l;
+			break;
+		}
+		}
+	}
+out:
+	offset += have - c;
+	if (npack) end_pack();
+	free(buf);
+
+	printf("%llu packs, %llu bytes\n", (unsigned long long)npack,
+	       (unsigned long long)offset);
+	for (i = 0; i < nstreams; i++){
+		v_stream *s = streams[i];
+		char n[16];
+
+		printf("stream %s: %llu packets", sname(s, n),
+		       (unsigned long long)s->packets);
+		if (s->size)
+			printf(", buffer %uK, at most %uK used", s->size/1024,
+			       s->dbuf.high/1024);
+		printf("\n");
+		free(s);
+	}
+	nstreams = 0;
+	for (i = 0; i < V_KINDS; i++){
+		if (!count[i]) continue;
+		printf("%s: %llu\n", v_name[i], (unsigned long long)count[i]);
+		problems += count[i];
+	}
+	if (!problems) printf("no problems found\n");
+	return problems;
+}
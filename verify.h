@@ -0,0 +1,37 @@
+/*
+ * verify.h
+ *
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef _VERIFY_H_
+#define _VERIFY_H_
+
+/* Checks a program stream against the output type otype (REPLEX_DVD
+   etc.) and prints what is wrong to stdout: SCRs going back or faster
+   than the mux rate, PTS or DTS before the SCR, P-STD buffer overflows
+   and, for DVD, the pack size, mux rate and NAV packs. Returns the
+   number of problems found. */
+long verify_ps(int fd, int otype);
+
+#endif /*_VERIFY_H_*/